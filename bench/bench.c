@@ -0,0 +1,367 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../test/fixtures.h"
+
+#define MPACK_API static
+#include "../build/mpack.c"
+
+/* Minimum amount of CPU time spent on each trial, in seconds. */
+#define BENCH_TIME 0.1
+#define BENCH_TRIALS 5
+
+static uint8_t mixed[0xfffff];
+static size_t mixedlen;
+static volatile size_t sink;
+
+static double cpu_time(void)
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void report(const char *name, double rate, const char *unit)
+{
+  printf("%-32s %10.2f M%s/s\n", name, rate / 1e6, unit);
+}
+
+/* Count the tokens in a buffer with mpack_read. The buffer is decoded
+ * repeatedly for BENCH_TRIALS trials of at least BENCH_TIME seconds, and the
+ * best trial is reported to filter out noise from other processes. */
+static void bench_read(const char *name, const uint8_t *mp, size_t mplen)
+{
+  double best = 0;
+
+  for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+    size_t count = 0;
+    double start = cpu_time(), elapsed;
+
+    do {
+      for (int i = 0; i < 16; i++) {
+        mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+        const char *b = (const char *)mp;
+        size_t bl = mplen;
+        mpack_token_t tok;
+        while (bl) {
+          if (mpack_read(&tb, &b, &bl, &tok)) abort();
+          sink += tok.type;
+          count++;
+        }
+      }
+    } while ((elapsed = cpu_time() - start) < BENCH_TIME);
+
+    if ((double)count / elapsed > best) best = (double)count / elapsed;
+  }
+
+  report(name, best, "tokens");
+}
+
+/* Skip every value in a buffer with mpack_skip, reporting bytes/s. */
+static void bench_skip(const char *name, const uint8_t *mp, size_t mplen)
+{
+  double best = 0;
+
+  for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+    size_t bytes = 0;
+    double start = cpu_time(), elapsed;
+
+    do {
+      for (int i = 0; i < 16; i++) {
+        mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+        const char *b = (const char *)mp;
+        size_t bl = mplen;
+        mpack_uint32_t state = 0;
+        while (bl) {
+          if (mpack_skip(&tb, &b, &bl, &state)) abort();
+        }
+        bytes += mplen;
+      }
+    } while ((elapsed = cpu_time() - start) < BENCH_TIME);
+
+    if ((double)bytes / elapsed > best) best = (double)bytes / elapsed;
+  }
+
+  report(name, best, "B");
+}
+
+static size_t nodes;
+
+static void count_enter(mpack_parser_t *parser, mpack_node_t *node)
+{
+  (void)parser;
+  sink += node->tok.type;
+  nodes++;
+}
+
+static void count_exit(mpack_parser_t *parser, mpack_node_t *node)
+{
+  (void)parser;
+  (void)node;
+}
+
+MPACK_DEFINE_PARSE(count_parse, count_enter, count_exit)
+
+static void count_center(mpack_cparser_t *parser, mpack_cnode_t *node)
+{
+  (void)node;
+  sink += parser->tok.type;
+  nodes++;
+}
+
+static void count_cexit(mpack_cparser_t *parser, mpack_cnode_t *node)
+{
+  (void)parser;
+  (void)node;
+}
+
+enum {
+  PARSE_CALLBACKS,
+  PARSE_EVENTS,
+  PARSE_GENERATED,
+  PARSE_COMPACT
+};
+
+/* Walk every object in a buffer, with mpack_parse callbacks, an inline
+ * mpack_next_event loop, a MPACK_DEFINE_PARSE parser or a mpack_cparser_t,
+ * reporting nodes/s. */
+static void bench_parse(const char *name, const uint8_t *mp, size_t mplen,
+    int mode)
+{
+  double best = 0;
+
+  for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+    double start = cpu_time(), elapsed;
+    nodes = 0;
+
+    do {
+      for (int i = 0; i < 16; i++) {
+        mpack_parser_t parser;
+        mpack_cparser_t cparser;
+        const char *b = (const char *)mp;
+        size_t bl = mplen;
+        if (mode == PARSE_COMPACT) {
+          mpack_cparser_init(&cparser, 0, 0);
+        } else {
+          mpack_parser_init(&parser, 0);
+        }
+        while (bl) {
+          if (mode == PARSE_COMPACT) {
+            if (mpack_cparse(&cparser, &b, &bl, count_center, count_cexit)) {
+              abort();
+            }
+          } else if (mode == PARSE_EVENTS) {
+            mpack_event_t ev;
+            if (mpack_next_event(&parser, &b, &bl, &ev)) abort();
+            if (ev.type == MPACK_EVENT_ENTER) {
+              sink += ev.node->tok.type;
+              nodes++;
+            }
+          } else if (mode == PARSE_GENERATED) {
+            if (count_parse(&parser, &b, &bl)) abort();
+          } else if (mpack_parse(&parser, &b, &bl, count_enter, count_exit)) {
+            abort();
+          }
+        }
+      }
+    } while ((elapsed = cpu_time() - start) < BENCH_TIME);
+
+    if ((double)nodes / elapsed > best) best = (double)nodes / elapsed;
+  }
+
+  report(name, best, "nodes");
+}
+
+/* Encode an array of integers of mixed widths, item by item with mpack_w_uint
+ * or in one call with mpack_w_uint_array. */
+static void bench_write_uints(const char *name, bool batch)
+{
+  static mpack_uintmax_t items[4096];
+  static char out[sizeof(items) / sizeof(items[0]) * MPACK_MAX_TOKEN_LEN];
+  size_t n = sizeof(items) / sizeof(items[0]);
+  double best = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    items[i] = (mpack_uintmax_t)1 << (i * 7 % 64);
+  }
+
+  for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+    size_t count = 0;
+    double start = cpu_time(), elapsed;
+
+    do {
+      for (int i = 0; i < 16; i++) {
+        mpack_writer_t w;
+        size_t written;
+        mpack_writer_init(&w, out, sizeof(out));
+        if (batch) {
+          if (mpack_w_uint_array(&w, items, n, &written)) abort();
+        } else {
+          for (size_t j = 0; j < n; j++) {
+            if (mpack_w_uint(&w, items[j])) abort();
+          }
+        }
+        sink += (size_t)(w.buf - out);
+        count += n;
+      }
+    } while ((elapsed = cpu_time() - start) < BENCH_TIME);
+
+    if ((double)count / elapsed > best) best = (double)count / elapsed;
+  }
+
+  report(name, best, "items");
+}
+
+/* Round trip doubles with exponents across the whole range(including
+ * subnormals) through the portable float conversions. */
+static void bench_float_compat(const char *name)
+{
+  static double values[2097];
+  size_t n = sizeof(values) / sizeof(values[0]);
+  double best = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    values[i] = ldexp(1.3, (int)i - 1074 + 1);
+  }
+
+  for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+    size_t count = 0;
+    double start = cpu_time(), elapsed;
+
+    do {
+      for (size_t i = 0; i < n; i++) {
+        mpack_token_t tok = mpack_pack_float_compat(values[i]);
+        if (mpack_unpack_float_compat(tok) != values[i]) abort();
+      }
+      count += n;
+    } while ((elapsed = cpu_time() - start) < BENCH_TIME);
+
+    if ((double)count / elapsed > best) best = (double)count / elapsed;
+  }
+
+  report(name, best, "floats");
+}
+
+/* Numbers as a scripting language binding sees them: doubles that are mostly
+ * integers of every size, with some fractional values mixed in. */
+static void bench_pack_number(const char *name)
+{
+  static double values[4096];
+  size_t n = sizeof(values) / sizeof(values[0]);
+  double best = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    double v = ldexp(1.0, (int)(i * 7 % 53)) + (double)i;
+    if (i % 4 == 3) v += 0.25;
+    values[i] = i % 2 ? -v : v;
+  }
+
+  for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+    size_t count = 0;
+    double start = cpu_time(), elapsed;
+
+    do {
+      for (size_t i = 0; i < n; i++) {
+        sink += mpack_pack_number(values[i]).length;
+      }
+      count += n;
+    } while ((elapsed = cpu_time() - start) < BENCH_TIME);
+
+    if ((double)count / elapsed > best) best = (double)count / elapsed;
+  }
+
+  report(name, best, "numbers");
+}
+
+static void load_fixture(const struct fixture *f, uint8_t **mp, size_t *mplen,
+    char **json)
+{
+  if (f->generator) {
+    f->generator(json, mp, mplen, f->generator_size);
+  } else {
+    *json = f->json;
+    *mp = f->msgpack;
+    *mplen = f->msgpacklen;
+  }
+}
+
+static const struct fixture *shuffled[2048];
+static size_t shuffled_count;
+
+static void add_fixtures(const struct fixture *fixtures, int count)
+{
+  for (int i = 0; i < count; i++) {
+    if (fixtures[i].generator) continue;
+    shuffled[shuffled_count++] = fixtures + i;
+  }
+}
+
+/* Concatenate every static fixture in a pseudo-random(but reproducible)
+ * order, which covers all type bytes with no pattern for the branch
+ * predictor to learn. */
+static void build_mixed(void)
+{
+  uint32_t seed = 0x2545f491;
+
+  add_fixtures(fixtures, fixture_count);
+  add_fixtures(number_fixtures, number_fixture_count);
+  for (size_t i = shuffled_count - 1; i > 0; i--) {
+    const struct fixture *tmp;
+    size_t j;
+    seed = seed * 1103515245 + 12345;
+    j = (seed >> 8) % (i + 1);
+    tmp = shuffled[i];
+    shuffled[i] = shuffled[j];
+    shuffled[j] = tmp;
+  }
+  for (size_t i = 0; i < shuffled_count; i++) {
+    memcpy(mixed + mixedlen, shuffled[i]->msgpack, shuffled[i]->msgpacklen);
+    mixedlen += shuffled[i]->msgpacklen;
+  }
+}
+
+int main(void)
+{
+  char name[64];
+
+  build_mixed();
+  bench_read("mixed fixtures", mixed, mixedlen);
+  bench_skip("skip mixed fixtures", mixed, mixedlen);
+  bench_parse("mpack_parse mixed fixtures", mixed, mixedlen, PARSE_CALLBACKS);
+  bench_parse("mpack_next_event mixed fixtures", mixed, mixedlen,
+      PARSE_EVENTS);
+  bench_parse("MPACK_DEFINE_PARSE mixed fixtures", mixed, mixedlen,
+      PARSE_GENERATED);
+  bench_parse("mpack_cparse mixed fixtures", mixed, mixedlen, PARSE_COMPACT);
+  printf("%-32s %10zu B\n", "sizeof(mpack_parser_t)",
+      sizeof(mpack_parser_t));
+  printf("%-32s %10zu B\n", "sizeof(mpack_cparser_t)",
+      sizeof(mpack_cparser_t));
+  printf("%-32s %10zu B\n", "sizeof(mpack_cparser_t), 2 slots",
+      sizeof(MPACK_CPARSER_STRUCT(MPACK_MAX_OBJECT_DEPTH, 2)));
+  bench_write_uints("mpack_w_uint", false);
+  bench_write_uints("mpack_w_uint_array", true);
+  bench_float_compat("float compat round trip");
+  bench_pack_number("mpack_pack_number");
+
+  for (int i = 0; i < fixture_count; i++) {
+    const struct fixture *f = fixtures + i;
+    uint8_t *mp;
+    size_t mplen;
+    char *json;
+    if (!f->generator) continue;
+    load_fixture(f, &mp, &mplen, &json);
+    /* str/bin/ext generators produce a single huge blob, which says nothing
+     * about token decoding */
+    if (*json == '"') continue;
+    snprintf(name, sizeof(name), "%.*s.. (%zu)", 12, json,
+        f->generator_size);
+    bench_read(name, mp, mplen);
+  }
+
+  return 0;
+}
@@ -1,14 +1,60 @@
 #include "conv.h"
+#include "encode.h"
+
+enum {
+  MPACK_NUMBER_UINT,
+  MPACK_NUMBER_SINT,
+  MPACK_NUMBER_FLOAT,
+  MPACK_NUMBER_DOUBLE
+};
 
 static int mpack_fits_single(double v);
+static int mpack_read_numbers(mpack_tokbuf_t *tb, const char **b, size_t *bl,
+    void *dst, int kind, size_t n, size_t *read);
+static size_t mpack_read_fixints(const char **b, size_t *bl, void *dst,
+    int kind, size_t i, size_t n);
+static size_t mpack_read_floats(const char **b, size_t *bl, void *dst,
+    int kind, size_t i, size_t n);
+static double mpack_rfloat(const unsigned char *p, mpack_uint32_t len);
+#ifdef MPACK_SSE2
+static int mpack_r_fixints16(const unsigned char *p, void *dst, int kind,
+    size_t i);
+# if defined(MPACK_SSSE3) && defined(MPACK_UNPACK_FLOAT_FAST)
+static int mpack_r_floats4(const unsigned char *p, void *dst, int kind,
+    size_t i);
+# endif
+#endif
+static int mpack_store_number(void *dst, int kind, size_t i,
+    mpack_token_t tok);
+#ifndef MPACK_NATIVE64
 static mpack_value_t mpack_pack_ieee754(double v, unsigned m, unsigned e);
 static int mpack_is_be(void) FPURE;
+# ifndef MPACK_PACK_FLOAT_FAST
 static double mpack_fmod_pow2_32(double a);
+# endif
+static double mpack_scale_pow2(double v, mpack_sint32_t e);
+#endif
 
 
 #define POW2(n) \
   ((double)(1 << (n / 2)) * (double)(1 << (n / 2)) * (double)(1 << (n % 2)))
 
+/* Number of entries in mpack_pow2, which is enough to scale by any double
+ * exponent. */
+#define MPACK_POW2_STEPS 10
+
+#ifndef MPACK_NATIVE64
+# define MPACK_POW2_64 (POW2(32) * POW2(32))
+# define MPACK_POW2_128 (MPACK_POW2_64 * MPACK_POW2_64)
+# define MPACK_POW2_256 (MPACK_POW2_128 * MPACK_POW2_128)
+
+/* mpack_pow2[i] = 2^(2^i) */
+static const double mpack_pow2[MPACK_POW2_STEPS] = {
+  POW2(1), POW2(2), POW2(4), POW2(8), POW2(16), POW2(32), MPACK_POW2_64,
+  MPACK_POW2_128, MPACK_POW2_256, MPACK_POW2_256 * MPACK_POW2_256
+};
+#endif
+
 #define MPACK_SWAP_VALUE(val)                                  \
   do {                                                         \
     mpack_uint32_t lo = val.lo;                                \
@@ -27,22 +73,38 @@ MPACK_API mpack_token_t mpack_pack_boolean(unsigned v)
 {
   mpack_token_t rv;
   rv.type = MPACK_TOKEN_BOOLEAN;
+#ifdef MPACK_NATIVE64
+  rv.data.value.u = v ? 1 : 0;
+#else
   rv.data.value.lo = v ? 1 : 0;
   rv.data.value.hi = 0;
+#endif
   return rv;
 }
 
 MPACK_API mpack_token_t mpack_pack_uint(mpack_uintmax_t v)
 {
   mpack_token_t rv;
+#ifdef MPACK_NATIVE64
+  rv.data.value.u = v;
+#else
   rv.data.value.lo = v & 0xffffffff;
   rv.data.value.hi = (mpack_uint32_t)((v >> 31) >> 1);
+#endif
   rv.type = MPACK_TOKEN_UINT;
   return rv;
 }
 
 MPACK_API mpack_token_t mpack_pack_sint(mpack_sintmax_t v)
 {
+#ifdef MPACK_NATIVE64
+  if (v < 0) {
+    mpack_token_t rv;
+    rv.data.value.i = v;
+    rv.type = MPACK_TOKEN_SINT;
+    return rv;
+  }
+#else
   if (v < 0) {
     mpack_token_t rv;
     mpack_uintmax_t tc = -((mpack_uintmax_t)(v + 1)) + 1;
@@ -51,6 +113,7 @@ MPACK_API mpack_token_t mpack_pack_sint(mpack_sintmax_t v)
     rv.type = MPACK_TOKEN_SINT;
     return rv;
   }
+#endif
 
   return mpack_pack_uint((mpack_uintmax_t)v);
 }
@@ -61,6 +124,10 @@ MPACK_API mpack_token_t mpack_pack_float_compat(double v)
    * represented in 4 bytes */
   mpack_token_t rv;
 
+#ifdef MPACK_NATIVE64
+  rv.length = mpack_fits_single(v) ? 4 : 8;
+  rv.data.value.d = v;
+#else
   if (mpack_fits_single(v)) {
     rv.length = 4;
     rv.data.value = mpack_pack_ieee754(v, 23, 8);
@@ -68,6 +135,7 @@ MPACK_API mpack_token_t mpack_pack_float_compat(double v)
     rv.length = 8;
     rv.data.value = mpack_pack_ieee754(v, 52, 11);
   }
+#endif
 
   rv.type = MPACK_TOKEN_FLOAT;
   return rv;
@@ -79,6 +147,10 @@ MPACK_API mpack_token_t mpack_pack_float_fast(double v)
    * represented in 4 bytes */
   mpack_token_t rv;
 
+#ifdef MPACK_NATIVE64
+  rv.length = mpack_fits_single(v) ? 4 : 8;
+  rv.data.value.d = v;
+#else
   if (mpack_fits_single(v)) {
     union {
       float f;
@@ -100,6 +172,7 @@ MPACK_API mpack_token_t mpack_pack_float_fast(double v)
       MPACK_SWAP_VALUE(rv.data.value);
     }
   }
+#endif
 
   rv.type = MPACK_TOKEN_FLOAT;
   return rv;
@@ -108,22 +181,106 @@ MPACK_API mpack_token_t mpack_pack_float_fast(double v)
 MPACK_API mpack_token_t mpack_pack_number(double v)
 {
   mpack_token_t tok;
-  double vabs;
-  vabs = v < 0 ? -v : v;
+#ifdef MPACK_NATIVE64
   assert(v <= 9007199254740991. && v >= -9007199254740991.);
-  tok.data.value.hi = (mpack_uint32_t)(vabs / POW2(32));
-  tok.data.value.lo = (mpack_uint32_t)mpack_fmod_pow2_32(vabs);
+
+  if (v < 0) {
+    mpack_sint64_t i = (mpack_sint64_t)v;
+    if ((double)i != v) return mpack_pack_float(v);
+    tok.type = MPACK_TOKEN_SINT;
+    tok.data.value.i = i;
+    if (i >= -0x80) tok.length = 1;
+    else if (i >= -0x8000) tok.length = 2;
+    else if (i >= -0x7fffffffll - 1) tok.length = 4;
+    else tok.length = 8;
+  } else {
+    mpack_uint64_t u = (mpack_uint64_t)v;
+    if ((double)u != v) return mpack_pack_float(v);
+    tok.type = MPACK_TOKEN_UINT;
+    tok.data.value.u = u;
+    if (u > 0xffffffff) tok.length = 8;
+    else if (u > 0xffff) tok.length = 4;
+    else if (u > 0xff) tok.length = 2;
+    else tok.length = 1;
+  }
+
+  return tok;
+#else
+  mpack_uint32_t hi, lo;
+  assert(v <= 9007199254740991. && v >= -9007199254740991.);
+
+#ifdef MPACK_PACK_FLOAT_FAST
+  {
+    mpack_sint32_t exponent;
+    unsigned shift;
+
+    if (v == 0) {
+      tok = mpack_pack_uint(0);
+      tok.length = 1;
+      return tok;
+    }
+
+    /* Classify the number using the ieee754 fields of its bit pattern(the
+     * same assumption made by mpack_pack_float_fast): it is an integer if no
+     * bits of the significand are below the binary point. */
+    {
+      union {
+        double d;
+        mpack_value_t m;
+      } conv;
+      conv.d = v;
+      if (mpack_is_be()) {
+        MPACK_SWAP_VALUE(conv.m);
+      }
+      hi = conv.m.hi;
+      lo = conv.m.lo;
+    }
+    exponent = (mpack_sint32_t)((hi >> 20) & 0x7ff) - 1023;
+    hi = (hi & 0xfffff) | 0x100000;
+
+    /* |v| < 1, |v| >= 2^53, infinity or NaN */
+    if (exponent < 0 || exponent > 52) return mpack_pack_float(v);
+
+    /* shift the 53-bit significand in hi:lo right by the number of
+     * fractional bits, bailing out if any of them is set */
+    shift = (unsigned)(52 - exponent);
+    if (shift >= 32) {
+      if (lo || (hi & (((mpack_uint32_t)1 << (shift - 32)) - 1))) {
+        return mpack_pack_float(v);
+      }
+      lo = hi >> (shift - 32);
+      hi = 0;
+    } else if (shift) {
+      if (lo & (((mpack_uint32_t)1 << shift) - 1)) return mpack_pack_float(v);
+      lo = ((lo >> shift) | (hi << (32 - shift))) & 0xffffffff;
+      hi >>= shift;
+    }
+  }
+#else
+  {
+    /* No assumptions about the representation: split the magnitude with
+     * arithmetic, and check that it was integral with the round-trip below */
+    double vabs = v < 0 ? -v : v;
+    hi = (mpack_uint32_t)(vabs / POW2(32));
+    lo = (mpack_uint32_t)mpack_fmod_pow2_32(vabs);
+  }
+#endif
+
+  tok.data.value.hi = hi;
+  tok.data.value.lo = lo;
 
   if (v < 0) {
     /* Compute the two's complement */
     tok.type = MPACK_TOKEN_SINT;
-    tok.data.value.hi = ~tok.data.value.hi;
-    tok.data.value.lo = ~tok.data.value.lo + 1;
+    tok.data.value.hi = ~tok.data.value.hi & 0xffffffff;
+    tok.data.value.lo = (~tok.data.value.lo + 1) & 0xffffffff;
     if (!tok.data.value.lo) tok.data.value.hi++;
-    if (tok.data.value.lo == 0 && tok.data.value.hi == 0) tok.length = 1;
-    else if (tok.data.value.lo < 0x80000000) tok.length = 8;
-    else if (tok.data.value.lo < 0xffff7fff) tok.length = 4;
-    else if (tok.data.value.lo < 0xffffff7f) tok.length = 2;
+    /* -1 < v < 0 truncates to zero, left for the round-trip check */
+    if (!tok.data.value.hi && !tok.data.value.lo) tok.length = 1;
+    else if (tok.data.value.hi != 0xffffffff
+        || tok.data.value.lo < 0x80000000) tok.length = 8;
+    else if (tok.data.value.lo < 0xffff8000) tok.length = 4;
+    else if (tok.data.value.lo < 0xffffff80) tok.length = 2;
     else tok.length = 1;
   } else {
     tok.type = MPACK_TOKEN_UINT;
@@ -133,11 +290,14 @@ MPACK_API mpack_token_t mpack_pack_number(double v)
     else tok.length = 1;
   }
 
+#ifndef MPACK_PACK_FLOAT_FAST
   if (mpack_unpack_number(tok) != v) {
     return mpack_pack_float(v);
   }
+#endif
 
   return tok;
+#endif
 }
 
 MPACK_API mpack_token_t mpack_pack_chunk(const char *p, mpack_uint32_t l)
@@ -190,6 +350,40 @@ MPACK_API mpack_token_t mpack_pack_map(mpack_uint32_t l)
   return rv;
 }
 
+#ifdef MPACK_NATIVE64
+MPACK_API bool mpack_unpack_boolean(mpack_token_t t)
+{
+  return t.data.value.u != 0;
+}
+
+MPACK_API mpack_uintmax_t mpack_unpack_uint(mpack_token_t t)
+{
+  return t.data.value.u;
+}
+
+MPACK_API mpack_sintmax_t mpack_unpack_sint(mpack_token_t t)
+{
+  return t.data.value.i;
+}
+
+MPACK_API double mpack_unpack_float_compat(mpack_token_t t)
+{
+  return t.data.value.d;
+}
+
+MPACK_API double mpack_unpack_float_fast(mpack_token_t t)
+{
+  return t.data.value.d;
+}
+
+MPACK_API double mpack_unpack_number(mpack_token_t t)
+{
+  if (t.type == MPACK_TOKEN_FLOAT) return t.data.value.d;
+  assert(t.type == MPACK_TOKEN_UINT || t.type == MPACK_TOKEN_SINT);
+  if (t.type == MPACK_TOKEN_SINT) return (double)t.data.value.i;
+  return (double)t.data.value.u;
+}
+#else
 MPACK_API bool mpack_unpack_boolean(mpack_token_t t)
 {
   return t.data.value.lo || t.data.value.hi;
@@ -249,14 +443,21 @@ MPACK_API double mpack_unpack_float_compat(mpack_token_t t)
     mant = t.data.value.lo & ((1 << 23) - 1);
   }
 
+  if (exponent == (1 << expbits) - 1) {
+    /* infinity(2^512 * 2^512 overflows) or NaN(inf - inf) */
+    double inf = mpack_pow2[MPACK_POW2_STEPS - 1] *
+      mpack_pow2[MPACK_POW2_STEPS - 1];
+    if (mant != 0) return inf - inf;
+    return sign ? -inf : inf;
+  }
+
   mant /= POW2(mantbits);
   if (exponent) mant += 1.0; /* restore leading 1 */
   else exponent = 1; /* subnormal */
   exponent -= bias;
 
   /* restore original value */
-  while (exponent > 0) mant *= 2.0, exponent--;
-  while (exponent < 0) mant /= 2.0, exponent++;
+  mant = mpack_scale_pow2(mant, exponent);
   return mant * (sign ? -1 : 1);
 }
 
@@ -310,12 +511,293 @@ MPACK_API double mpack_unpack_number(mpack_token_t t)
   rv = (double)lo + POW2(32) * hi;
   return t.type == MPACK_TOKEN_SINT ? -rv : rv;
 }
+#endif
+
+/* Decode the next `n` items of an array(after its header was read) into a C
+ * array, storing the number of items converted in *read. Returns MPACK_OK
+ * once all items were converted and MPACK_EOF when the buffer ends first, in
+ * which case the call should be repeated for the remaining items with more
+ * data. Items that are not numbers, or don't fit the destination type, make
+ * it return MPACK_ERROR. */
+MPACK_API int mpack_read_uint_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, mpack_uintmax_t *dst, size_t n, size_t *read)
+{
+  return mpack_read_numbers(tb, b, bl, dst, MPACK_NUMBER_UINT, n, read);
+}
+
+MPACK_API int mpack_read_sint_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, mpack_sintmax_t *dst, size_t n, size_t *read)
+{
+  return mpack_read_numbers(tb, b, bl, dst, MPACK_NUMBER_SINT, n, read);
+}
+
+MPACK_API int mpack_read_float_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, float *dst, size_t n, size_t *read)
+{
+  return mpack_read_numbers(tb, b, bl, dst, MPACK_NUMBER_FLOAT, n, read);
+}
+
+MPACK_API int mpack_read_double_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, double *dst, size_t n, size_t *read)
+{
+  return mpack_read_numbers(tb, b, bl, dst, MPACK_NUMBER_DOUBLE, n, read);
+}
+
+static int mpack_read_numbers(mpack_tokbuf_t *tb, const char **b, size_t *bl,
+    void *dst, int kind, size_t n, size_t *read)
+{
+  int status = MPACK_OK;
+  size_t i = 0;
+
+  while (i < n && *bl) {
+    mpack_token_t tok;
+
+    if (!tb->plen) {
+      /* runs of fixints and floats are converted without building tokens */
+      size_t start = i;
+      i = mpack_read_fixints(b, bl, dst, kind, i, n);
+      if (kind == MPACK_NUMBER_FLOAT || kind == MPACK_NUMBER_DOUBLE) {
+        i = mpack_read_floats(b, bl, dst, kind, i, n);
+      }
+      if (i == n || !*bl) break;
+      if (i != start) continue;
+    }
+
+    if ((status = mpack_read(tb, b, bl, &tok))) break;
+    if ((status = mpack_store_number(dst, kind, i, tok))) break;
+    i++;
+  }
+
+  *read = i;
+  if (status) return status;
+  return i == n ? MPACK_OK : MPACK_EOF;
+}
+
+static size_t mpack_read_fixints(const char **b, size_t *bl, void *dst,
+    int kind, size_t i, size_t n)
+{
+  const unsigned char *p = (const unsigned char *)*b;
+  const unsigned char *end = p + (*bl < n - i ? *bl : n - i);
+
+#ifdef MPACK_SSE2
+  while (end - p >= 16 && mpack_r_fixints16(p, dst, kind, i)) {
+    p += 16;
+    i += 16;
+  }
+#endif
+  if (kind == MPACK_NUMBER_UINT) {
+    mpack_uintmax_t *d = dst;
+    for (; p < end && *p < 0x80; p++) d[i++] = *p;
+  } else {
+    for (; p < end && (*p < 0x80 || *p >= 0xe0); p++, i++) {
+      int v = *p < 0x80 ? *p : *p - 0x100;
+      switch (kind) {
+        case MPACK_NUMBER_SINT: ((mpack_sintmax_t *)dst)[i] = v; break;
+        case MPACK_NUMBER_FLOAT: ((float *)dst)[i] = (float)v; break;
+        default: ((double *)dst)[i] = v; break;
+      }
+    }
+  }
+
+  *bl -= (size_t)(p - (const unsigned char *)*b);
+  *b = (const char *)p;
+  return i;
+}
+
+/* Items that are complete float 32/64 values in the buffer. */
+static size_t mpack_read_floats(const char **b, size_t *bl, void *dst,
+    int kind, size_t i, size_t n)
+{
+  const unsigned char *p = (const unsigned char *)*b;
+  const unsigned char *end = p + *bl;
+
+#if defined(MPACK_SSSE3) && defined(MPACK_UNPACK_FLOAT_FAST)
+  /* blocks are only tried where a run starts: checking for them between
+   * items of mixed widths costs more than it saves */
+  while (n - i >= 4 && end - p >= 20 && mpack_r_floats4(p, dst, kind, i)) {
+    p += 20;
+    i += 4;
+  }
+#endif
+  for (; i < n && p < end; i++) {
+    double v;
+    if (*p == 0xcb && end - p >= 9) {
+      v = mpack_rfloat(p + 1, 8);
+      p += 9;
+    } else if (*p == 0xca && end - p >= 5) {
+      v = mpack_rfloat(p + 1, 4);
+      p += 5;
+    } else {
+      break;
+    }
+    if (kind == MPACK_NUMBER_FLOAT) ((float *)dst)[i] = (float)v;
+    else ((double *)dst)[i] = v;
+  }
+
+  *bl -= (size_t)(p - (const unsigned char *)*b);
+  *b = (const char *)p;
+  return i;
+}
+
+/* Convert the `len` bytes long big-endian payload of a float item. */
+static double mpack_rfloat(const unsigned char *p, mpack_uint32_t len)
+{
+  mpack_token_t tok;
+  mpack_uint32_t hi = 0, lo = 0;
+
+  tok.type = MPACK_TOKEN_FLOAT;
+  tok.length = len;
+#ifdef MPACK_BSWAP
+  if (len == 8) {
+    unsigned long long v = mpack_load64((const char *)p);
+    hi = (mpack_uint32_t)(v >> 32);
+    lo = (mpack_uint32_t)v;
+  } else {
+    lo = mpack_load32((const char *)p);
+  }
+#else
+  while (len--) {
+    hi = ((hi << 8) | (lo >> 24)) & 0xffffffff;
+    lo = ((lo << 8) | *p++) & 0xffffffff;
+  }
+#endif
+
+#ifdef MPACK_NATIVE64
+  if (tok.length == 4) {
+    union {
+      float f;
+      mpack_uint32_t m;
+    } conv;
+    conv.m = lo;
+    return conv.f;
+  }
+  tok.data.value.u = (mpack_uint64_t)hi << 32 | lo;
+#else
+  tok.data.value.hi = hi;
+  tok.data.value.lo = lo;
+#endif
+  return mpack_unpack_float(tok);
+}
+
+#ifdef MPACK_SSE2
+/* Convert 16 fixint bytes if all of them are fixints the destination
+ * accepts: 0..0x7f for unsigned items, -0x20..0x7f otherwise. The bytes are
+ * sign-extended to 32 bits and converted or widened from there. */
+static int mpack_r_fixints16(const unsigned char *p, void *dst, int kind,
+    size_t i)
+{
+  __m128i b = _mm_loadu_si128((const __m128i *)p);
+  __m128i zero = _mm_setzero_si128(), w, x[4];
+  int k;
+
+  if (_mm_movemask_epi8(kind == MPACK_NUMBER_UINT ? b :
+        _mm_cmplt_epi8(b, _mm_set1_epi8(-0x20)))) {
+    return 0;
+  }
+
+  w = _mm_unpacklo_epi8(b, _mm_cmplt_epi8(b, zero));
+  x[0] = _mm_unpacklo_epi16(w, _mm_srai_epi16(w, 15));
+  x[1] = _mm_unpackhi_epi16(w, _mm_srai_epi16(w, 15));
+  w = _mm_unpackhi_epi8(b, _mm_cmplt_epi8(b, zero));
+  x[2] = _mm_unpacklo_epi16(w, _mm_srai_epi16(w, 15));
+  x[3] = _mm_unpackhi_epi16(w, _mm_srai_epi16(w, 15));
+
+  for (k = 0; k < 4; k++) {
+    size_t j = i + (size_t)k * 4;
+    if (kind == MPACK_NUMBER_FLOAT) {
+      _mm_storeu_ps((float *)dst + j, _mm_cvtepi32_ps(x[k]));
+    } else if (kind == MPACK_NUMBER_DOUBLE) {
+      _mm_storeu_pd((double *)dst + j, _mm_cvtepi32_pd(x[k]));
+      _mm_storeu_pd((double *)dst + j + 2,
+          _mm_cvtepi32_pd(_mm_srli_si128(x[k], 8)));
+    } else {
+      /* both integer destinations are 64-bit when MPACK_BSWAP is defined */
+      __m128i s = _mm_srai_epi32(x[k], 31);
+      __m128i *d = (__m128i *)((mpack_uintmax_t *)dst + j);
+      _mm_storeu_si128(d, _mm_unpacklo_epi32(x[k], s));
+      _mm_storeu_si128(d + 1, _mm_unpackhi_epi32(x[k], s));
+    }
+  }
+  return 1;
+}
+
+# if defined(MPACK_SSSE3) && defined(MPACK_UNPACK_FLOAT_FAST)
+/* Convert 4 consecutive 0xca items(20 bytes) with two byte shuffles. A float
+ * destination leaves NaNs to the scalar path, which converts through double
+ * and so quiets signaling NaNs. */
+static int mpack_r_floats4(const unsigned char *p, void *dst, int kind,
+    size_t i)
+{
+  __m128 f;
+
+  if (p[0] != 0xca || p[5] != 0xca || p[10] != 0xca || p[15] != 0xca) {
+    return 0;
+  }
+
+  /* payloads are at bytes 1-4, 6-9 and 11-14 of p and 12-15 of p + 4 */
+  f = _mm_castsi128_ps(_mm_or_si128(
+      _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p),
+        _mm_setr_epi8(4, 3, 2, 1, 9, 8, 7, 6, 14, 13, 12, 11, -1, -1, -1,
+          -1)),
+      _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 4)),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 15,
+          14, 13, 12))));
+
+  if (kind == MPACK_NUMBER_DOUBLE) {
+    _mm_storeu_pd((double *)dst + i, _mm_cvtps_pd(f));
+    _mm_storeu_pd((double *)dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+  } else {
+    if (_mm_movemask_ps(_mm_cmpunord_ps(f, f))) return 0;
+    _mm_storeu_ps((float *)dst + i, f);
+  }
+  return 1;
+}
+# endif
+#endif
+
+static int mpack_store_number(void *dst, int kind, size_t i,
+    mpack_token_t tok)
+{
+  if (tok.type != MPACK_TOKEN_UINT && tok.type != MPACK_TOKEN_SINT &&
+      (tok.type != MPACK_TOKEN_FLOAT || kind == MPACK_NUMBER_UINT ||
+       kind == MPACK_NUMBER_SINT)) {
+    return MPACK_ERROR;
+  }
+
+  switch (kind) {
+    case MPACK_NUMBER_UINT:
+      if (tok.type != MPACK_TOKEN_UINT ||
+          tok.length > sizeof(mpack_uintmax_t)) return MPACK_ERROR;
+      ((mpack_uintmax_t *)dst)[i] = mpack_unpack_uint(tok);
+      break;
+    case MPACK_NUMBER_SINT:
+      if (tok.length > sizeof(mpack_sintmax_t) ||
+          (tok.type == MPACK_TOKEN_UINT &&
+           tok.length == sizeof(mpack_sintmax_t) &&
+           mpack_unpack_uint(tok) > (mpack_uintmax_t)-1 / 2)) {
+        return MPACK_ERROR;
+      }
+      ((mpack_sintmax_t *)dst)[i] = tok.type == MPACK_TOKEN_UINT ?
+        (mpack_sintmax_t)mpack_unpack_uint(tok) : mpack_unpack_sint(tok);
+      break;
+    case MPACK_NUMBER_FLOAT:
+      ((float *)dst)[i] = (float)mpack_unpack_number(tok);
+      break;
+    default:
+      ((double *)dst)[i] = mpack_unpack_number(tok);
+      break;
+  }
+
+  return MPACK_OK;
+}
 
 static int mpack_fits_single(double v)
 {
   return (float)v == v;
 }
 
+#ifndef MPACK_NATIVE64
+
 static mpack_value_t mpack_pack_ieee754(double v, unsigned mantbits,
     unsigned expbits)
 {
@@ -323,6 +805,7 @@ static mpack_value_t mpack_pack_ieee754(double v, unsigned mantbits,
   mpack_sint32_t exponent, bias = (1 << (expbits - 1)) - 1;
   mpack_uint32_t sign;
   double mant;
+  int i;
 
   if (v == 0) {
     rv.lo = 0;
@@ -333,12 +816,44 @@ static mpack_value_t mpack_pack_ieee754(double v, unsigned mantbits,
   if (v < 0) sign = 1, mant = -v;
   else sign = 0, mant = v;
 
+  if (mant - mant != 0) {
+    /* infinity or NaN: all exponent bits set, with the top mantissa bit set
+     * for a(quiet) NaN */
+    exponent = (1 << expbits) - 1;
+    if (mantbits == 52) {
+      rv.hi = ((mpack_uint32_t)exponent << 20) | (sign << 31);
+      if (mant != mant) rv.hi |= (mpack_uint32_t)1 << 19;
+    } else {
+      rv.lo = ((mpack_uint32_t)exponent << 23) | (sign << 31);
+      if (mant != mant) rv.lo |= (mpack_uint32_t)1 << 22;
+    }
+    goto end;
+  }
+
+  /* normalize the mantissa to [1, 2) with a fixed number of steps, scaling
+   * by 2^512, 2^256, ..., 2^1 when needed. Subnormal doubles need to be
+   * scaled up by more than 2^1023, so the largest step is done twice. */
   exponent = 0;
-  while (mant >= 2.0) mant /= 2.0, exponent++;
-  while (mant < 1.0 && exponent > -(bias - 1)) mant *= 2.0, exponent--;
+  for (i = MPACK_POW2_STEPS - 1; i >= 0; i--) {
+    if (mant >= mpack_pow2[i]) mant /= mpack_pow2[i], exponent += 1 << i;
+  }
+  if (mant * mpack_pow2[MPACK_POW2_STEPS - 1] < 2.0) {
+    mant *= mpack_pow2[MPACK_POW2_STEPS - 1];
+    exponent -= 1 << (MPACK_POW2_STEPS - 1);
+  }
+  for (i = MPACK_POW2_STEPS - 1; i >= 0; i--) {
+    if (mant * mpack_pow2[i] < 2.0) {
+      mant *= mpack_pow2[i], exponent -= 1 << i;
+    }
+  }
 
-  if (mant < 1.0) exponent = -bias; /* subnormal value */
-  else mant = mant - 1.0; /* remove leading 1 */
+  if (exponent < -(bias - 1)) {
+    /* subnormal value */
+    mant = mpack_scale_pow2(mant, exponent + bias - 1);
+    exponent = -bias;
+  } else {
+    mant = mant - 1.0; /* remove leading 1 */
+  }
   exponent += bias;
   mant *= POW2(mantbits);
 
@@ -367,9 +882,28 @@ static int mpack_is_be(void)
   return test.c[0] == 0;
 }
 
+#ifndef MPACK_PACK_FLOAT_FAST
 /* this simplified version of `fmod` that returns the remainder of double
  * division by 0xffffffff, which is enough for our purposes */
 static double mpack_fmod_pow2_32(double a)
 {
   return a - ((double)(mpack_uint32_t)(a / POW2(32)) * POW2(32));
 }
+#endif
+
+/* v * 2^e, for |e| < 2^MPACK_POW2_STEPS */
+static double mpack_scale_pow2(double v, mpack_sint32_t e)
+{
+  int i;
+  mpack_uint32_t m = (mpack_uint32_t)(e < 0 ? -e : e);
+  assert(m < (1u << MPACK_POW2_STEPS));
+
+  for (i = 0; i < MPACK_POW2_STEPS; i++) {
+    if (!(m >> i & 1)) continue;
+    if (e < 0) v /= mpack_pow2[i];
+    else v *= mpack_pow2[i];
+  }
+
+  return v;
+}
+#endif
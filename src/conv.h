@@ -35,17 +35,30 @@ MPACK_API mpack_sintmax_t mpack_unpack_sint(mpack_token_t t) FUNUSED FPURE;
 MPACK_API double mpack_unpack_float_fast(mpack_token_t t) FUNUSED FPURE;
 MPACK_API double mpack_unpack_float_compat(mpack_token_t t) FUNUSED FPURE;
 MPACK_API double mpack_unpack_number(mpack_token_t t) FUNUSED FPURE;
+MPACK_API int mpack_read_uint_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, mpack_uintmax_t *dst, size_t n, size_t *read)
+  FUNUSED FNONULL;
+MPACK_API int mpack_read_sint_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, mpack_sintmax_t *dst, size_t n, size_t *read)
+  FUNUSED FNONULL;
+MPACK_API int mpack_read_float_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, float *dst, size_t n, size_t *read) FUNUSED FNONULL;
+MPACK_API int mpack_read_double_array(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, double *dst, size_t n, size_t *read) FUNUSED FNONULL;
 
 /* The mpack_{pack,unpack}_float_fast functions should work in 99% of the
  * platforms. When compiling for a platform where floats don't use ieee754 as
  * the internal format, pass
  * -Dmpack_{pack,unpack}_float=mpack_{pack,unpack}_float_compat to the
- *  compiler.*/
+ *  compiler. MPACK_{PACK,UNPACK}_FLOAT_FAST tell the library code that reads
+ *  float bit patterns directly whether the fast variants are in use.*/
 #ifndef mpack_pack_float
 # define mpack_pack_float mpack_pack_float_fast
+# define MPACK_PACK_FLOAT_FAST
 #endif
 #ifndef mpack_unpack_float
 # define mpack_unpack_float mpack_unpack_float_fast
+# define MPACK_UNPACK_FLOAT_FAST
 #endif
 
 #endif  /* MPACK_CONV_H */
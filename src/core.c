@@ -1,6 +1,7 @@
 #include <string.h>
 
 #include "core.h"
+#include "encode.h"
 
 #define UNUSED(p) (void)p;
 #define ADVANCE(buf, buflen) ((*buflen)--, (unsigned char)*((*buf)++))
@@ -8,6 +9,11 @@
 #ifndef MIN
 # define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
 #endif
+#ifdef MPACK_NATIVE64
+# define MPACK_VALUE_LO(v) ((mpack_uint32_t)(v).u)
+#else
+# define MPACK_VALUE_LO(v) ((v).lo)
+#endif
 
 static int mpack_rtoken(const char **buf, size_t *buflen,
     mpack_token_t *tok);
@@ -18,19 +24,10 @@ static int mpack_rblob(mpack_token_type_t t, mpack_uint32_t l,
     const char **b, size_t *bl, mpack_token_t *tok);
 static int mpack_wtoken(const mpack_token_t *tok, char **b, size_t *bl);
 static int mpack_wpending(char **b, size_t *bl, mpack_tokbuf_t *tb);
-static int mpack_wpint(char **b, size_t *bl, mpack_value_t v);
-static int mpack_wnint(char **b, size_t *bl, mpack_value_t v);
-static int mpack_wfloat(char **b, size_t *bl, const mpack_token_t *v);
-static int mpack_wstr(char **buf, size_t *buflen, mpack_uint32_t len);
-static int mpack_wbin(char **buf, size_t *buflen, mpack_uint32_t len);
 static int mpack_wext(char **buf, size_t *buflen, int type,
     mpack_uint32_t len);
-static int mpack_warray(char **buf, size_t *buflen, mpack_uint32_t len);
-static int mpack_wmap(char **buf, size_t *buflen, mpack_uint32_t len);
-static int mpack_w1(char **b, size_t *bl, mpack_uint32_t v);
-static int mpack_w2(char **b, size_t *bl, mpack_uint32_t v);
-static int mpack_w4(char **b, size_t *bl, mpack_uint32_t v);
 static mpack_value_t mpack_byte(unsigned char b);
+static mpack_value_t mpack_rbe(const char **b, size_t *bl, mpack_uint32_t w);
 static int mpack_value(mpack_token_type_t t, mpack_uint32_t l,
     mpack_value_t v, mpack_token_t *tok);
 static int mpack_blob(mpack_token_type_t t, mpack_uint32_t l, int et,
@@ -106,6 +103,317 @@ done:
   return MPACK_OK;
 }
 
+/* Read up to `max` tokens into `toks`, returning how many were read. Tokens
+ * that are fully contained in *buf are decoded in a tight loop, only the
+ * trailing partial token(if any) goes through the tokbuf pending logic of
+ * mpack_read. When less than `max` tokens are returned and *buflen is not 0,
+ * the byte at *buf is invalid(mpack_read would return MPACK_ERROR). */
+MPACK_API size_t mpack_read_batch(mpack_tokbuf_t *tokbuf, const char **buf,
+    size_t *buflen, mpack_token_t *toks, size_t max)
+{
+  size_t count = 0;
+  const char *ptr = *buf;
+  size_t ptrlen = *buflen;
+
+  while (count < max && ptrlen) {
+    mpack_token_t *tok = toks + count;
+
+    if (tokbuf->passthrough) {
+      tok->type = MPACK_TOKEN_CHUNK;
+      tok->data.chunk_ptr = ptr;
+      tok->length = MIN((mpack_uint32_t)ptrlen, tokbuf->passthrough);
+      tokbuf->passthrough -= tok->length;
+      ptr += tok->length;
+      ptrlen -= tok->length;
+    } else {
+      const char *p = ptr;
+      size_t plen = ptrlen;
+
+      if (tokbuf->plen || mpack_rtoken(&p, &plen, tok)) {
+        /* partial or invalid token, let mpack_read deal with it */
+        int status;
+        *buf = ptr;
+        *buflen = ptrlen;
+        status = mpack_read(tokbuf, buf, buflen, tok);
+        ptr = *buf;
+        ptrlen = *buflen;
+        if (status) break;
+      } else {
+        ptr = p;
+        ptrlen = plen;
+        if (tok->type > MPACK_TOKEN_MAP) {
+          tokbuf->passthrough = tok->length;
+        }
+      }
+    }
+
+    count++;
+  }
+
+  *buf = ptr;
+  *buflen = ptrlen;
+  return count;
+}
+
+/* Number of bytes mpack_write produces for a token: the payload length for
+ * chunks and 0 if the token is invalid. */
+MPACK_API size_t mpack_token_size(const mpack_token_t *tok)
+{
+  mpack_uint32_t len = tok->length;
+
+  switch (tok->type) {
+    case MPACK_TOKEN_NIL:
+    case MPACK_TOKEN_BOOLEAN:
+      return 1;
+    case MPACK_TOKEN_SINT: {
+#ifdef MPACK_NATIVE64
+      mpack_sint64_t v = tok->data.value.i;
+      if (v < 0) {
+        return v < -0x7fffffffll - 1 ? 9 : v < -0x8000 ? 5 : v < -0x80 ? 3 :
+               v < -0x20 ? 2 : 1;
+      }
+#else
+      mpack_uint32_t lo = tok->data.value.lo;
+      mpack_uint32_t hi = tok->data.value.hi;
+      if (!mpack_nonneg(tok->data.value)) {
+        return (hi && hi != 0xffffffff) || lo < 0x80000000 ? 9 :
+               lo < 0xffff8000 ? 5 :
+               lo < 0xffffff80 ? 3 : lo < 0xffffffe0 ? 2 : 1;
+      }
+#endif
+      /* non-negative values are written as uint */
+    }
+    /* fallthrough */
+    case MPACK_TOKEN_UINT: {
+#ifdef MPACK_NATIVE64
+      mpack_uint64_t v = tok->data.value.u;
+      return v > 0xffffffff ? 9 : v > 0xffff ? 5 : v > 0xff ? 3 :
+             v > 0x7f ? 2 : 1;
+#else
+      mpack_uint32_t lo = tok->data.value.lo;
+      return tok->data.value.hi ? 9 : lo > 0xffff ? 5 : lo > 0xff ? 3 :
+             lo > 0x7f ? 2 : 1;
+#endif
+    }
+    case MPACK_TOKEN_FLOAT:
+      return len == 4 ? 5 : len == 8 ? 9 : 0;
+    case MPACK_TOKEN_CHUNK:
+      return len;
+    case MPACK_TOKEN_STR:
+      return len < 0x20 ? 1 : len < 0x100 ? 2 : len < 0x10000 ? 3 : 5;
+    case MPACK_TOKEN_BIN:
+      return len < 0x100 ? 2 : len < 0x10000 ? 3 : 5;
+    case MPACK_TOKEN_EXT:
+      if (len == 1 || len == 2 || len == 4 || len == 8 || len == 16) return 2;
+      return len < 0x100 ? 3 : len < 0x10000 ? 4 : 6;
+    case MPACK_TOKEN_ARRAY:
+    case MPACK_TOKEN_MAP:
+      return len < 0x10 ? 1 : len < 0x10000 ? 3 : 5;
+    default:
+      return 0;
+  }
+}
+
+/* Write up to `n` tokens, storing the number of tokens fully written in
+ * *written. The encoded size of each run of tokens that fits in *buf is
+ * computed up front so the run is emitted with no bounds checks or pending
+ * copies. Returns MPACK_OK when all tokens were written and MPACK_EOF when
+ * *buf is full, in which case the token at toks[*written] may have been
+ * partially written and must be passed again(first) in the next call. */
+MPACK_API int mpack_write_batch(mpack_tokbuf_t *tokbuf, char **buf,
+    size_t *buflen, const mpack_token_t *toks, size_t n, size_t *written)
+{
+  int status = MPACK_OK;
+  size_t i = 0;
+
+  if (n && tokbuf->plen) {
+    /* finish the token left pending by the previous call */
+    if (!*buflen) {
+      status = MPACK_EOF;
+      goto end;
+    }
+    if ((status = mpack_write(tokbuf, buf, buflen, toks))) goto end;
+    i++;
+  }
+
+  while (i < n) {
+    size_t j, runlen = 0;
+
+    for (j = i; j < n; j++) {
+      size_t size = mpack_token_size(toks + j);
+      if ((!size && toks[j].type != MPACK_TOKEN_CHUNK) ||
+          size > *buflen - runlen) {
+        break;
+      }
+      runlen += size;
+    }
+
+    for (; i < j; i++) {
+      if (toks[i].type == MPACK_TOKEN_CHUNK) {
+        memcpy(*buf, toks[i].data.chunk_ptr, toks[i].length);
+        *buf += toks[i].length;
+        *buflen -= toks[i].length;
+      } else {
+        mpack_wtoken(toks + i, buf, buflen);
+      }
+    }
+
+    if (i == n) break;
+
+    /* the next token doesn't fit(or is invalid), let mpack_write stage it */
+    if (!*buflen) {
+      status = MPACK_EOF;
+      break;
+    }
+    if ((status = mpack_write(tokbuf, buf, buflen, toks + i))) break;
+    i++;
+  }
+
+end:
+  *written = i;
+  return status;
+}
+
+/* Skip over the next value, including all of its children and str/bin/ext
+ * payloads, without producing tokens. `*state` must be 0 when starting to skip
+ * a value and holds the number of items left while the value is split across
+ * buffers. Returns MPACK_OK once the whole value was consumed(*state is 0
+ * again), MPACK_EOF if more data is required or MPACK_ERROR. */
+MPACK_API int mpack_skip(mpack_tokbuf_t *tokbuf, const char **buf,
+    size_t *buflen, mpack_uint32_t *state)
+{
+  int status;
+  mpack_uint32_t remaining = *state ? *state : 1;
+  const char *ptr = *buf;
+  size_t ptrlen = *buflen;
+  assert(*state || !tokbuf->passthrough);
+
+  for (;;) {
+    mpack_token_t tok;
+    const char *p;
+    size_t plen;
+
+    status = MPACK_EOF;
+    if (tokbuf->passthrough) {
+      /* jump over as much of the payload as is available */
+      mpack_uint32_t n = ptrlen < tokbuf->passthrough ?
+        (mpack_uint32_t)ptrlen : tokbuf->passthrough;
+      tokbuf->passthrough -= n;
+      ptr += n;
+      ptrlen -= n;
+      if (tokbuf->passthrough) break;
+      /* the str/bin/ext is only complete after its payload */
+      remaining--;
+    }
+
+    if (!remaining) {
+      status = MPACK_OK;
+      break;
+    }
+
+    if (!ptrlen) break;
+
+    p = ptr;
+    plen = ptrlen;
+    if (tokbuf->plen || mpack_rtoken(&p, &plen, &tok)) {
+      /* partial or invalid token, let mpack_read deal with it */
+      *buf = ptr;
+      *buflen = ptrlen;
+      status = mpack_read(tokbuf, buf, buflen, &tok);
+      ptr = *buf;
+      ptrlen = *buflen;
+      if (status) break;
+    } else {
+      ptr = p;
+      ptrlen = plen;
+      if (tok.type > MPACK_TOKEN_MAP) {
+        tokbuf->passthrough = tok.length;
+      }
+    }
+
+    if (tokbuf->passthrough) continue;
+
+    remaining--;
+    if (tok.type == MPACK_TOKEN_ARRAY || tok.type == MPACK_TOKEN_MAP) {
+      mpack_uint32_t items = tok.length;
+      if (tok.type == MPACK_TOKEN_MAP) {
+        if (items > 0x7fffffff) {
+          status = MPACK_ERROR;
+          break;
+        }
+        items *= 2;
+      }
+      if (items > 0xffffffff - remaining) {
+        /* too many nested items to count */
+        status = MPACK_ERROR;
+        break;
+      }
+      remaining += items;
+    }
+  }
+
+  *buf = ptr;
+  *buflen = ptrlen;
+  *state = remaining;
+  return status;
+}
+
+/* Check that buf holds exactly one well-formed value that respects `limits`.
+ * Only a counter of items left per nesting level is kept. Returns MPACK_OK,
+ * MPACK_EOF if the value is truncated or MPACK_ERROR if it is invalid, exceeds
+ * one of the limits or is followed by trailing bytes. */
+MPACK_API int mpack_validate(const char *buf, size_t buflen,
+    const mpack_limits_t *limits)
+{
+  mpack_uint32_t remaining[MPACK_VALIDATE_MAX_DEPTH + 1];
+  mpack_uint32_t depth = 0;
+  mpack_uint32_t max_depth = limits->depth;
+
+  /* remaining has no room for deeper limits, don't silently lower them */
+  if (max_depth > MPACK_VALIDATE_MAX_DEPTH) return MPACK_ERROR;
+  remaining[0] = 1;
+
+  for (;;) {
+    int status;
+    mpack_token_t tok;
+    mpack_uint32_t items;
+
+    while (!remaining[depth]) {
+      if (!depth) return buflen ? MPACK_ERROR : MPACK_OK;
+      depth--;
+    }
+
+    if (!buflen) return MPACK_EOF;
+    if ((status = mpack_rtoken(&buf, &buflen, &tok))) return status;
+    remaining[depth]--;
+
+    switch (tok.type) {
+      case MPACK_TOKEN_BIN:
+      case MPACK_TOKEN_STR:
+      case MPACK_TOKEN_EXT:
+        if (tok.length > limits->blob) return MPACK_ERROR;
+        if (buflen < tok.length) return MPACK_EOF;
+        buf += tok.length;
+        buflen -= tok.length;
+        break;
+      case MPACK_TOKEN_ARRAY:
+      case MPACK_TOKEN_MAP:
+        if (tok.length > limits->length || depth == max_depth) {
+          return MPACK_ERROR;
+        }
+        items = tok.length;
+        if (tok.type == MPACK_TOKEN_MAP) {
+          if (items > 0x7fffffff) return MPACK_ERROR;
+          items *= 2;
+        }
+        remaining[++depth] = items;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
 MPACK_API int mpack_write(mpack_tokbuf_t *tokbuf, char **buf, size_t *buflen,
     const mpack_token_t *t)
 {
@@ -167,81 +475,110 @@ MPACK_API int mpack_write(mpack_tokbuf_t *tokbuf, char **buf, size_t *buflen,
   return MPACK_OK;
 }
 
+/* Descriptor for each of the 256 possible type bytes, so mpack_rtoken can
+ * classify a token with a single table lookup. */
+typedef struct mpack_lead_s {
+  unsigned char type;    /* mpack_token_type_t, 0 if the byte is invalid */
+  unsigned char kind;    /* how the rest of the token is read, MPACK_LEAD_* */
+  unsigned char width;   /* bytes following the type byte(value or length) */
+  unsigned char length;  /* fixed part of the token length */
+  unsigned char lmask;   /* bits of the type byte added to the length */
+  unsigned char vmask;   /* bits of the type byte holding the value */
+} mpack_lead_t;
+
+enum {
+  MPACK_LEAD_INVALID = 0,
+  MPACK_LEAD_IMMEDIATE, /* fully contained in the type byte */
+  MPACK_LEAD_RVALUE,    /* followed by a 1-8 byte value: int/uint/float */
+  MPACK_LEAD_RBLOB,     /* followed by a 1-4 byte length: str/bin/ext/... */
+  MPACK_LEAD_FIXEXT     /* followed by the ext type byte */
+};
+
+#define LEAD(type, kind, width, length, lmask, vmask) \
+  { MPACK_TOKEN_##type, MPACK_LEAD_##kind, width, length, lmask, vmask }
+#define LEAD_X2(l) LEAD l, LEAD l
+#define LEAD_X4(l) LEAD_X2(l), LEAD_X2(l)
+#define LEAD_X8(l) LEAD_X4(l), LEAD_X4(l)
+#define LEAD_X16(l) LEAD_X8(l), LEAD_X8(l)
+#define LEAD_X32(l) LEAD_X16(l), LEAD_X16(l)
+#define LEAD_X64(l) LEAD_X32(l), LEAD_X32(l)
+#define LEAD_X128(l) LEAD_X64(l), LEAD_X64(l)
+
+static const mpack_lead_t mpack_leads[256] = {
+  LEAD_X128((UINT, IMMEDIATE, 0, 1, 0, 0xff)),  /* 0x00-0x7f pos fixint */
+  LEAD_X16((MAP, IMMEDIATE, 0, 0, 0x0f, 0)),    /* 0x80-0x8f fixmap */
+  LEAD_X16((ARRAY, IMMEDIATE, 0, 0, 0x0f, 0)),  /* 0x90-0x9f fixarray */
+  LEAD_X32((STR, IMMEDIATE, 0, 0, 0x1f, 0)),    /* 0xa0-0xbf fixstr */
+  LEAD(NIL, IMMEDIATE, 0, 0, 0, 0),             /* 0xc0 nil */
+  { 0, MPACK_LEAD_INVALID, 0, 0, 0, 0 },        /* 0xc1 never used */
+  LEAD(BOOLEAN, IMMEDIATE, 0, 1, 0, 0),         /* 0xc2 false */
+  LEAD(BOOLEAN, IMMEDIATE, 0, 1, 0, 0x01),      /* 0xc3 true */
+  LEAD(BIN, RBLOB, 1, 0, 0, 0),                 /* 0xc4 bin 8 */
+  LEAD(BIN, RBLOB, 2, 0, 0, 0),                 /* 0xc5 bin 16 */
+  LEAD(BIN, RBLOB, 4, 0, 0, 0),                 /* 0xc6 bin 32 */
+  LEAD(EXT, RBLOB, 1, 0, 0, 0),                 /* 0xc7 ext 8 */
+  LEAD(EXT, RBLOB, 2, 0, 0, 0),                 /* 0xc8 ext 16 */
+  LEAD(EXT, RBLOB, 4, 0, 0, 0),                 /* 0xc9 ext 32 */
+  LEAD(FLOAT, RVALUE, 4, 0, 0, 0),              /* 0xca float 32 */
+  LEAD(FLOAT, RVALUE, 8, 0, 0, 0),              /* 0xcb float 64 */
+  LEAD(UINT, RVALUE, 1, 0, 0, 0),               /* 0xcc uint 8 */
+  LEAD(UINT, RVALUE, 2, 0, 0, 0),               /* 0xcd uint 16 */
+  LEAD(UINT, RVALUE, 4, 0, 0, 0),               /* 0xce uint 32 */
+  LEAD(UINT, RVALUE, 8, 0, 0, 0),               /* 0xcf uint 64 */
+  LEAD(SINT, RVALUE, 1, 0, 0, 0),               /* 0xd0 int 8 */
+  LEAD(SINT, RVALUE, 2, 0, 0, 0),               /* 0xd1 int 16 */
+  LEAD(SINT, RVALUE, 4, 0, 0, 0),               /* 0xd2 int 32 */
+  LEAD(SINT, RVALUE, 8, 0, 0, 0),               /* 0xd3 int 64 */
+  LEAD(EXT, FIXEXT, 1, 1, 0, 0),                /* 0xd4 fixext 1 */
+  LEAD(EXT, FIXEXT, 1, 2, 0, 0),                /* 0xd5 fixext 2 */
+  LEAD(EXT, FIXEXT, 1, 4, 0, 0),                /* 0xd6 fixext 4 */
+  LEAD(EXT, FIXEXT, 1, 8, 0, 0),                /* 0xd7 fixext 8 */
+  LEAD(EXT, FIXEXT, 1, 16, 0, 0),               /* 0xd8 fixext 16 */
+  LEAD(STR, RBLOB, 1, 0, 0, 0),                 /* 0xd9 str 8 */
+  LEAD(STR, RBLOB, 2, 0, 0, 0),                 /* 0xda str 16 */
+  LEAD(STR, RBLOB, 4, 0, 0, 0),                 /* 0xdb str 32 */
+  LEAD(ARRAY, RBLOB, 2, 0, 0, 0),               /* 0xdc array 16 */
+  LEAD(ARRAY, RBLOB, 4, 0, 0, 0),               /* 0xdd array 32 */
+  LEAD(MAP, RBLOB, 2, 0, 0, 0),                 /* 0xde map 16 */
+  LEAD(MAP, RBLOB, 4, 0, 0, 0),                 /* 0xdf map 32 */
+  LEAD_X32((SINT, IMMEDIATE, 0, 1, 0, 0xff))    /* 0xe0-0xff neg fixint */
+};
+
 static int mpack_rtoken(const char **buf, size_t *buflen,
     mpack_token_t *tok)
 {
   unsigned char t = ADVANCE(buf, buflen);
-  if (t < 0x80) {
-    /* positive fixint */
-    return mpack_value(MPACK_TOKEN_UINT, 1, mpack_byte(t), tok);
-  } else if (t < 0x90) {
-    /* fixmap */
-    return mpack_blob(MPACK_TOKEN_MAP, t & 0xf, 0, tok);
-  } else if (t < 0xa0) {
-    /* fixarray */
-    return mpack_blob(MPACK_TOKEN_ARRAY, t & 0xf, 0, tok);
-  } else if (t < 0xc0) {
-    /* fixstr */
-    return mpack_blob(MPACK_TOKEN_STR, t & 0x1f, 0, tok);
-  } else if (t < 0xe0) {
-    switch (t) {
-      case 0xc0:  /* nil */
-        return mpack_value(MPACK_TOKEN_NIL, 0, mpack_byte(0), tok);
-      case 0xc2:  /* false */
-        return mpack_value(MPACK_TOKEN_BOOLEAN, 1, mpack_byte(0), tok);
-      case 0xc3:  /* true */
-        return mpack_value(MPACK_TOKEN_BOOLEAN, 1, mpack_byte(1), tok);
-      case 0xc4:  /* bin 8 */
-      case 0xc5:  /* bin 16 */
-      case 0xc6:  /* bin 32 */
-        return mpack_rblob(MPACK_TOKEN_BIN, TLEN(t, 0xc4), buf, buflen, tok);
-      case 0xc7:  /* ext 8 */
-      case 0xc8:  /* ext 16 */
-      case 0xc9:  /* ext 32 */
-        return mpack_rblob(MPACK_TOKEN_EXT, TLEN(t, 0xc7), buf, buflen, tok);
-      case 0xca:  /* float 32 */
-      case 0xcb:  /* float 64 */
-        return mpack_rvalue(MPACK_TOKEN_FLOAT, TLEN(t, 0xc8), buf, buflen, tok);
-      case 0xcc:  /* uint 8 */
-      case 0xcd:  /* uint 16 */
-      case 0xce:  /* uint 32 */
-      case 0xcf:  /* uint 64 */
-        return mpack_rvalue(MPACK_TOKEN_UINT, TLEN(t, 0xcc), buf, buflen, tok);
-      case 0xd0:  /* int 8 */
-      case 0xd1:  /* int 16 */
-      case 0xd2:  /* int 32 */
-      case 0xd3:  /* int 64 */
-        return mpack_rvalue(MPACK_TOKEN_SINT, TLEN(t, 0xd0), buf, buflen, tok);
-      case 0xd4:  /* fixext 1 */
-      case 0xd5:  /* fixext 2 */
-      case 0xd6:  /* fixext 4 */
-      case 0xd7:  /* fixext 8 */
-      case 0xd8:  /* fixext 16 */
-        if (*buflen == 0) {
-          /* require only one extra byte for the type code */
-          tok->length = 1;
-          return MPACK_EOF;
-        }
-        tok->length = TLEN(t, 0xd4);
-        tok->type = MPACK_TOKEN_EXT;
-        tok->data.ext_type = ADVANCE(buf, buflen);
-        return MPACK_OK;
-      case 0xd9:  /* str 8 */
-      case 0xda:  /* str 16 */
-      case 0xdb:  /* str 32 */
-        return mpack_rblob(MPACK_TOKEN_STR, TLEN(t, 0xd9), buf, buflen, tok);
-      case 0xdc:  /* array 16 */
-      case 0xdd:  /* array 32 */
-        return mpack_rblob(MPACK_TOKEN_ARRAY, TLEN(t, 0xdb), buf, buflen, tok);
-      case 0xde:  /* map 16 */
-      case 0xdf:  /* map 32 */
-        return mpack_rblob(MPACK_TOKEN_MAP, TLEN(t, 0xdd), buf, buflen, tok);
-      default:
-        return MPACK_ERROR;
+  const mpack_lead_t *lead = mpack_leads + t;
+  mpack_token_type_t type = (mpack_token_type_t)lead->type;
+
+  if (lead->kind == MPACK_LEAD_IMMEDIATE) {
+    /* the most common case(fixint, fixstr, fixarray, fixmap...) is handled
+     * without branching on the token type */
+    mpack_value(type, (mpack_uint32_t)(lead->length + (t & lead->lmask)),
+        mpack_byte((unsigned char)(t & lead->vmask)), tok);
+#ifdef MPACK_NATIVE64
+    if (type == MPACK_TOKEN_SINT) {
+      /* negative fixint */
+      tok->data.value.i = (mpack_sint64_t)t - 0x100;
     }
-  } else {
-    /* negative fixint */
-    return mpack_value(MPACK_TOKEN_SINT, 1, mpack_byte(t), tok);
+#endif
+    return MPACK_OK;
+  }
+
+  switch (lead->kind) {
+    case MPACK_LEAD_RVALUE:
+      return mpack_rvalue(type, lead->width, buf, buflen, tok);
+    case MPACK_LEAD_RBLOB:
+      return mpack_rblob(type, lead->width, buf, buflen, tok);
+    case MPACK_LEAD_FIXEXT:
+      if (*buflen == 0) {
+        /* require only one extra byte for the type code */
+        tok->length = 1;
+        return MPACK_EOF;
+      }
+      return mpack_blob(type, lead->length, ADVANCE(buf, buflen), tok);
+    default:
+      return MPACK_ERROR;
   }
 }
 
@@ -270,21 +607,26 @@ static int mpack_rvalue(mpack_token_type_t type, mpack_uint32_t remaining,
     return MPACK_EOF;
   }
 
-  mpack_value(type, remaining, mpack_byte(0), tok);
+  mpack_value(type, remaining, mpack_rbe(buf, buflen, remaining), tok);
 
-  while (remaining) {
-    mpack_uint32_t byte = ADVANCE(buf, buflen), byte_idx, byte_shift;
-    byte_idx = (mpack_uint32_t)--remaining;
-    byte_shift = (byte_idx % 4) * 8;
-    tok->data.value.lo |= byte << byte_shift;
-    if (remaining == 4) {
-      /* unpacked the first half of a 8-byte value, shift what was parsed to the
-       * "hi" field and reset "lo" for the trailing 4 bytes. */
-      tok->data.value.hi = tok->data.value.lo;
-      tok->data.value.lo = 0;
+#ifdef MPACK_NATIVE64
+  if (type == MPACK_TOKEN_SINT) {
+    mpack_uint32_t bits = remaining * 8;
+    if (!(tok->data.value.u >> (bits - 1))) {
+      tok->type = MPACK_TOKEN_UINT;
+    } else if (bits < 64) {
+      /* sign extend */
+      tok->data.value.u |= ~(mpack_uint64_t)0 << bits;
     }
+  } else if (type == MPACK_TOKEN_FLOAT && remaining == 4) {
+    union {
+      float f;
+      mpack_uint32_t m;
+    } conv;
+    conv.m = (mpack_uint32_t)tok->data.value.u;
+    tok->data.value.d = conv.f;
   }
-
+#else
   if (type == MPACK_TOKEN_SINT) {
     mpack_uint32_t hi = tok->data.value.hi;
     mpack_uint32_t lo = tok->data.value.lo;
@@ -296,6 +638,7 @@ static int mpack_rvalue(mpack_token_type_t type, mpack_uint32_t remaining,
       tok->type = MPACK_TOKEN_UINT;
     }
   }
+#endif
 
   return MPACK_OK;
 }
@@ -303,7 +646,7 @@ static int mpack_rvalue(mpack_token_type_t type, mpack_uint32_t remaining,
 static int mpack_rblob(mpack_token_type_t type, mpack_uint32_t tlen,
     const char **buf, size_t *buflen, mpack_token_t *tok)
 {
-  mpack_token_t l;
+  mpack_value_t l;
   mpack_uint32_t required = tlen + (type == MPACK_TOKEN_EXT ? 1 : 0);
 
   if (*buflen < required) {
@@ -311,10 +654,9 @@ static int mpack_rblob(mpack_token_type_t type, mpack_uint32_t tlen,
     return MPACK_EOF;
   }
 
-  l.data.value.lo = 0;
-  mpack_rvalue(MPACK_TOKEN_UINT, tlen, buf, buflen, &l);
+  l = mpack_rbe(buf, buflen, tlen);
   tok->type = type;
-  tok->length = l.data.value.lo;
+  tok->length = MPACK_VALUE_LO(l);
 
   if (type == MPACK_TOKEN_EXT) {
     tok->data.ext_type = ADVANCE(buf, buflen);
@@ -330,7 +672,7 @@ static int mpack_wtoken(const mpack_token_t *tok, char **buf,
     case MPACK_TOKEN_NIL:
       return mpack_w1(buf, buflen, 0xc0);
     case MPACK_TOKEN_BOOLEAN:
-      return mpack_w1(buf, buflen, tok->data.value.lo ? 0xc3 : 0xc2);
+      return mpack_w1(buf, buflen, MPACK_VALUE_LO(tok->data.value) ? 0xc3 : 0xc2);
     case MPACK_TOKEN_UINT:
       return mpack_wpint(buf, buflen, tok->data.value);
     case MPACK_TOKEN_SINT:
@@ -368,106 +710,6 @@ static int mpack_wpending(char **buf, size_t *buflen, mpack_tokbuf_t *state)
   return MPACK_EOF;
 }
 
-static int mpack_wpint(char **buf, size_t *buflen, mpack_value_t val)
-{
-  mpack_uint32_t hi = val.hi;
-  mpack_uint32_t lo = val.lo;
-
-  if (hi) {
-    /* uint 64 */
-    return mpack_w1(buf, buflen, 0xcf) ||
-           mpack_w4(buf, buflen, hi)   ||
-           mpack_w4(buf, buflen, lo);
-  } else if (lo > 0xffff) {
-    /* uint 32 */
-    return mpack_w1(buf, buflen, 0xce) ||
-           mpack_w4(buf, buflen, lo);
-  } else if (lo > 0xff) {
-    /* uint 16 */
-    return mpack_w1(buf, buflen, 0xcd) ||
-           mpack_w2(buf, buflen, lo);
-  } else if (lo > 0x7f) {
-    /* uint 8 */
-    return mpack_w1(buf, buflen, 0xcc) ||
-           mpack_w1(buf, buflen, lo);
-  } else {
-    return mpack_w1(buf, buflen, lo);
-  }
-}
-
-static int mpack_wnint(char **buf, size_t *buflen, mpack_value_t val)
-{
-  mpack_uint32_t hi = val.hi;
-  mpack_uint32_t lo = val.lo;
-
-  if (lo < 0x80000000) {
-    /* int 64 */
-    return mpack_w1(buf, buflen, 0xd3) ||
-           mpack_w4(buf, buflen, hi)   ||
-           mpack_w4(buf, buflen, lo);
-  } else if (lo < 0xffff7fff) {
-    /* int 32 */
-    return mpack_w1(buf, buflen, 0xd2) ||
-           mpack_w4(buf, buflen, lo);
-  } else if (lo < 0xffffff7f) {
-    /* int 16 */
-    return mpack_w1(buf, buflen, 0xd1) ||
-           mpack_w2(buf, buflen, lo);
-  } else if (lo < 0xffffffe0) {
-    /* int 8 */
-    return mpack_w1(buf, buflen, 0xd0) ||
-           mpack_w1(buf, buflen, lo);
-  } else {
-    /* negative fixint */
-    return mpack_w1(buf, buflen, (mpack_uint32_t)(0x100 + lo));
-  }
-}
-
-static int mpack_wfloat(char **buf, size_t *buflen,
-    const mpack_token_t *tok)
-{
-  if (tok->length == 4) {
-    return mpack_w1(buf, buflen, 0xca) ||
-           mpack_w4(buf, buflen, tok->data.value.lo);
-  } else if (tok->length == 8) {
-    return mpack_w1(buf, buflen, 0xcb) ||
-           mpack_w4(buf, buflen, tok->data.value.hi) ||
-           mpack_w4(buf, buflen, tok->data.value.lo);
-  } else {
-    return MPACK_ERROR;
-  }
-}
-
-static int mpack_wstr(char **buf, size_t *buflen, mpack_uint32_t len)
-{
-  if (len < 0x20) {
-    return mpack_w1(buf, buflen, 0xa0 | len);
-  } else if (len < 0x100) {
-    return mpack_w1(buf, buflen, 0xd9) ||
-           mpack_w1(buf, buflen, len);
-  } else if (len < 0x10000) {
-    return mpack_w1(buf, buflen, 0xda) ||
-           mpack_w2(buf, buflen, len);
-  } else {
-    return mpack_w1(buf, buflen, 0xdb) ||
-           mpack_w4(buf, buflen, len);
-  }
-}
-
-static int mpack_wbin(char **buf, size_t *buflen, mpack_uint32_t len)
-{
-  if (len < 0x100) {
-    return mpack_w1(buf, buflen, 0xc4) ||
-           mpack_w1(buf, buflen, len);
-  } else if (len < 0x10000) {
-    return mpack_w1(buf, buflen, 0xc5) ||
-           mpack_w2(buf, buflen, len);
-  } else {
-    return mpack_w1(buf, buflen, 0xc6) ||
-           mpack_w4(buf, buflen, len);
-  }
-}
-
 static int mpack_wext(char **buf, size_t *buflen, int type,
     mpack_uint32_t len)
 {
@@ -475,79 +717,24 @@ static int mpack_wext(char **buf, size_t *buflen, int type,
   assert(type >= 0 && type < 0x80);
   t = (mpack_uint32_t)type;
   switch (len) {
-    case 1: mpack_w1(buf, buflen, 0xd4); return mpack_w1(buf, buflen, t);
-    case 2: mpack_w1(buf, buflen, 0xd5); return mpack_w1(buf, buflen, t);
-    case 4: mpack_w1(buf, buflen, 0xd6); return mpack_w1(buf, buflen, t);
-    case 8: mpack_w1(buf, buflen, 0xd7); return mpack_w1(buf, buflen, t);
-    case 16: mpack_w1(buf, buflen, 0xd8); return mpack_w1(buf, buflen, t);
+    case 1: return mpack_wh1(buf, buflen, 0xd4, t);
+    case 2: return mpack_wh1(buf, buflen, 0xd5, t);
+    case 4: return mpack_wh1(buf, buflen, 0xd6, t);
+    case 8: return mpack_wh1(buf, buflen, 0xd7, t);
+    case 16: return mpack_wh1(buf, buflen, 0xd8, t);
     default:
       if (len < 0x100) {
-        return mpack_w1(buf, buflen, 0xc7) ||
-               mpack_w1(buf, buflen, len)  ||
-               mpack_w1(buf, buflen, t);
+        return mpack_wh2(buf, buflen, 0xc7, (len << 8) | t);
       } else if (len < 0x10000) {
-        return mpack_w1(buf, buflen, 0xc8) ||
-               mpack_w2(buf, buflen, len)  ||
+        return mpack_wh2(buf, buflen, 0xc8, len) ||
                mpack_w1(buf, buflen, t);
       } else {
-        return mpack_w1(buf, buflen, 0xc9) ||
-               mpack_w4(buf, buflen, len)  ||
+        return mpack_wh4(buf, buflen, 0xc9, len) ||
                mpack_w1(buf, buflen, t);
       }
   }
 }
 
-static int mpack_warray(char **buf, size_t *buflen, mpack_uint32_t len)
-{
-  if (len < 0x10) {
-    return mpack_w1(buf, buflen, 0x90 | len);
-  } else if (len < 0x10000) {
-    return mpack_w1(buf, buflen, 0xdc) ||
-           mpack_w2(buf, buflen, len);
-  } else {
-    return mpack_w1(buf, buflen, 0xdd) ||
-           mpack_w4(buf, buflen, len);
-  }
-}
-
-static int mpack_wmap(char **buf, size_t *buflen, mpack_uint32_t len)
-{
-  if (len < 0x10) {
-    return mpack_w1(buf, buflen, 0x80 | len);
-  } else if (len < 0x10000) {
-    return mpack_w1(buf, buflen, 0xde) ||
-           mpack_w2(buf, buflen, len);
-  } else {
-    return mpack_w1(buf, buflen, 0xdf) ||
-           mpack_w4(buf, buflen, len);
-  }
-}
-
-static int mpack_w1(char **b, size_t *bl, mpack_uint32_t v)
-{
-  (*bl)--;
-  *(*b)++ = (char)(v & 0xff);
-  return MPACK_OK;
-}
-
-static int mpack_w2(char **b, size_t *bl, mpack_uint32_t v)
-{
-  *bl -= 2;
-  *(*b)++ = (char)((v >> 8) & 0xff);
-  *(*b)++ = (char)(v & 0xff);
-  return MPACK_OK;
-}
-
-static int mpack_w4(char **b, size_t *bl, mpack_uint32_t v)
-{
-  *bl -= 4;
-  *(*b)++ = (char)((v >> 24) & 0xff);
-  *(*b)++ = (char)((v >> 16) & 0xff);
-  *(*b)++ = (char)((v >> 8) & 0xff);
-  *(*b)++ = (char)(v & 0xff);
-  return MPACK_OK;
-}
-
 static int mpack_value(mpack_token_type_t type, mpack_uint32_t length,
     mpack_value_t value, mpack_token_t *tok)
 {
@@ -569,7 +756,54 @@ static int mpack_blob(mpack_token_type_t type, mpack_uint32_t length,
 static mpack_value_t mpack_byte(unsigned char byte)
 {
   mpack_value_t rv;
+#ifdef MPACK_NATIVE64
+  rv.u = byte;
+#else
   rv.lo = byte;
   rv.hi = 0;
+#endif
+  return rv;
+}
+
+/* Read a "width" bytes long big-endian unsigned value. The caller must ensure
+ * the buffer has enough data. */
+static mpack_value_t mpack_rbe(const char **buf, size_t *buflen,
+    mpack_uint32_t width)
+{
+  mpack_value_t rv;
+#ifdef MPACK_BSWAP
+  unsigned long long v;
+  switch (width) {
+    case 1: v = (unsigned char)**buf; break;
+    case 2: v = mpack_load16(*buf); break;
+    case 4: v = mpack_load32(*buf); break;
+    default: v = mpack_load64(*buf); break;
+  }
+  *buf += width;
+  *buflen -= width;
+# ifdef MPACK_NATIVE64
+  rv.u = v;
+# else
+  rv.hi = (mpack_uint32_t)(v >> 32);
+  rv.lo = (mpack_uint32_t)v;
+# endif
+#elif defined(MPACK_NATIVE64)
+  rv.u = 0;
+  while (width--) rv.u = (rv.u << 8) | ADVANCE(buf, buflen);
+#else
+  rv.lo = rv.hi = 0;
+  while (width) {
+    mpack_uint32_t byte = ADVANCE(buf, buflen), byte_idx, byte_shift;
+    byte_idx = --width;
+    byte_shift = (byte_idx % 4) * 8;
+    rv.lo |= byte << byte_shift;
+    if (width == 4) {
+      /* unpacked the first half of a 8-byte value, shift what was parsed to the
+       * "hi" field and reset "lo" for the trailing 4 bytes. */
+      rv.hi = rv.lo;
+      rv.lo = 0;
+    }
+  }
+#endif
   return rv;
 }
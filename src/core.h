@@ -31,9 +31,26 @@ typedef unsigned long mpack_uint32_t;
 # error "can't find unsigned 32-bit integer type"
 #endif
 
+#ifdef MPACK_NATIVE64
+/* Scalars are stored in native 64-bit form: integers in "u"/"i" (sint tokens
+ * are sign extended) and floats of both widths in "d". This requires a 64-bit
+ * integer type and ieee754 floats. */
+# if !defined(ULLONG_MAX) || ULLONG_MAX != 0xffffffffffffffff
+#  error "MPACK_NATIVE64 requires a 64-bit long long"
+# endif
+typedef long long mpack_sint64_t;
+typedef unsigned long long mpack_uint64_t;
+
+typedef union mpack_value_u {
+  mpack_uint64_t u;
+  mpack_sint64_t i;
+  double d;
+} mpack_value_t;
+#else
 typedef struct mpack_value_s {
   mpack_uint32_t lo, hi;
 } mpack_value_t;
+#endif
 
 
 enum {
@@ -44,6 +61,10 @@ enum {
 
 #define MPACK_MAX_TOKEN_LEN 9  /* 64-bit ints/floats plus type code */
 
+#ifndef MPACK_VALIDATE_MAX_DEPTH
+# define MPACK_VALIDATE_MAX_DEPTH 32
+#endif
+
 typedef enum {
   MPACK_TOKEN_NIL       = 1,
   MPACK_TOKEN_BOOLEAN   = 2,
@@ -63,7 +84,7 @@ typedef struct mpack_token_s {
   mpack_uint32_t length;    /* Byte length for str/bin/ext/chunk/float/int/uint.
                                Item count for array/map. */
   union {
-    mpack_value_t value;    /* 32-bit parts of primitives (bool,int,float) */
+    mpack_value_t value;    /* Primitives (bool,int,float), see above */
     const char *chunk_ptr;  /* Chunk of data from str/bin/ext */
     int ext_type;           /* Type field for ext tokens */
   } data;
@@ -76,11 +97,33 @@ typedef struct mpack_tokbuf_s {
   mpack_uint32_t passthrough;
 } mpack_tokbuf_t;
 
-#define MPACK_TOKBUF_INITIAL_VALUE { { 0 }, { 0, 0, { { 0, 0 } } }, 0, 0, 0 }
+typedef struct mpack_limits_s {
+  mpack_uint32_t depth;   /* Maximum container nesting(at most
+                             MPACK_VALIDATE_MAX_DEPTH, mpack_validate returns
+                             MPACK_ERROR for larger values), 0 for scalars
+                             only */
+  mpack_uint32_t length;  /* Maximum item count for array/map */
+  mpack_uint32_t blob;    /* Maximum byte length for str/bin/ext */
+} mpack_limits_t;
+
+#ifdef MPACK_NATIVE64
+# define MPACK_TOKBUF_INITIAL_VALUE { { 0 }, { 0, 0, { { 0 } } }, 0, 0, 0 }
+#else
+# define MPACK_TOKBUF_INITIAL_VALUE { { 0 }, { 0, 0, { { 0, 0 } } }, 0, 0, 0 }
+#endif
 
 MPACK_API void mpack_tokbuf_init(mpack_tokbuf_t *tb) FUNUSED FNONULL;
 MPACK_API int mpack_read(mpack_tokbuf_t *tb, const char **b, size_t *bl,
     mpack_token_t *tok) FUNUSED FNONULL;
+MPACK_API size_t mpack_read_batch(mpack_tokbuf_t *tb, const char **b,
+    size_t *bl, mpack_token_t *toks, size_t max) FUNUSED FNONULL;
+MPACK_API size_t mpack_token_size(const mpack_token_t *tok) FUNUSED FNONULL;
+MPACK_API int mpack_write_batch(mpack_tokbuf_t *tb, char **b, size_t *bl,
+    const mpack_token_t *toks, size_t n, size_t *written) FUNUSED FNONULL;
+MPACK_API int mpack_skip(mpack_tokbuf_t *tb, const char **b, size_t *bl,
+    mpack_uint32_t *state) FUNUSED FNONULL;
+MPACK_API int mpack_validate(const char *b, size_t bl,
+    const mpack_limits_t *limits) FUNUSED FNONULL;
 MPACK_API int mpack_write(mpack_tokbuf_t *tb, char **b, size_t *bl,
     const mpack_token_t *tok) FUNUSED FNONULL;
 
@@ -0,0 +1,392 @@
+#include <string.h>
+
+#include "cursor.h"
+
+static int mpack_cursor_read(mpack_cursor_t *c, mpack_token_t *tok,
+    const char **next);
+static void mpack_cursor_consume(mpack_cursor_t *c, const char *next);
+static int mpack_cursor_enter(mpack_cursor_t *c, mpack_token_type_t type,
+    mpack_uint32_t *len);
+static int mpack_children(const mpack_token_t *tok, mpack_uint32_t *items);
+
+enum {
+  MPACK_EXTRACT_VALUE = 0,  /* next value is matched against the path */
+  MPACK_EXTRACT_TARGET,     /* next value is the one being extracted */
+  MPACK_EXTRACT_KEY,        /* next value is a map key */
+  MPACK_EXTRACT_KEYCMP,     /* comparing the payload of a map key */
+  MPACK_EXTRACT_DONE        /* skipping over the extracted value */
+};
+
+MPACK_API void mpack_cursor_init(mpack_cursor_t *cursor, const char *buf,
+    size_t buflen)
+{
+  cursor->buf = buf;
+  cursor->end = buf + buflen;
+  cursor->depth = 0;
+  cursor->frames[0].start = buf;
+  cursor->frames[0].count = cursor->frames[0].remaining = 0;
+  cursor->frames[0].is_map = 0;
+}
+
+/* Decode the next token without consuming it. Returns MPACK_EOF when there
+ * are no more items in the current container(or in the buffer, at the top
+ * level) and MPACK_ERROR if the data is invalid or truncated. The functions
+ * below return the same codes. */
+MPACK_API int mpack_cursor_peek(mpack_cursor_t *cursor, mpack_token_t *tok)
+{
+  const char *next;
+  return mpack_cursor_read(cursor, tok, &next);
+}
+
+/* Skip the next value, including all of its children. */
+MPACK_API int mpack_cursor_next(mpack_cursor_t *cursor)
+{
+  int status;
+  mpack_token_t tok;
+  mpack_tokbuf_t tokbuf;
+  mpack_uint32_t state = 0;
+  const char *next, *ptr;
+  size_t ptrlen;
+
+  if ((status = mpack_cursor_read(cursor, &tok, &next))) return status;
+  mpack_tokbuf_init(&tokbuf);
+  ptr = cursor->buf;
+  ptrlen = (size_t)(cursor->end - ptr);
+  if (mpack_skip(&tokbuf, &ptr, &ptrlen, &state)) return MPACK_ERROR;
+  mpack_cursor_consume(cursor, ptr);
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_cursor_enter_array(mpack_cursor_t *cursor,
+    mpack_uint32_t *len)
+{
+  return mpack_cursor_enter(cursor, MPACK_TOKEN_ARRAY, len);
+}
+
+MPACK_API int mpack_cursor_enter_map(mpack_cursor_t *cursor,
+    mpack_uint32_t *len)
+{
+  return mpack_cursor_enter(cursor, MPACK_TOKEN_MAP, len);
+}
+
+/* Skip the rest of the current container and move to the value after it. */
+MPACK_API int mpack_cursor_leave(mpack_cursor_t *cursor)
+{
+  mpack_cursor_frame_t *frame;
+
+  if (!cursor->depth) return MPACK_ERROR;
+  frame = cursor->frames + cursor->depth;
+
+  if (frame->remaining) {
+    mpack_tokbuf_t tokbuf;
+    const char *ptr = cursor->buf;
+    size_t ptrlen = (size_t)(cursor->end - ptr);
+    /* mpack_skip state is the number of items left to skip */
+    mpack_uint32_t state = frame->remaining;
+    mpack_tokbuf_init(&tokbuf);
+    if (mpack_skip(&tokbuf, &ptr, &ptrlen, &state)) return MPACK_ERROR;
+    cursor->buf = ptr;
+  }
+
+  cursor->depth--;
+  return MPACK_OK;
+}
+
+/* Position the cursor at the value associated with `key` in the current map.
+ * The search always starts from the first key, so fields can be looked up
+ * in any order. */
+MPACK_API int mpack_cursor_find_key(mpack_cursor_t *cursor, const char *key)
+{
+  mpack_cursor_frame_t *frame = cursor->frames + cursor->depth;
+  size_t keylen = strlen(key);
+
+  if (!frame->is_map) return MPACK_ETYPE;
+  cursor->buf = frame->start;
+  frame->remaining = frame->count;
+
+  while (frame->remaining) {
+    int status;
+    mpack_token_t tok;
+    const char *next;
+
+    if ((status = mpack_cursor_read(cursor, &tok, &next))) return status;
+
+    if (tok.type == MPACK_TOKEN_STR && tok.length == keylen &&
+        !memcmp(next, key, keylen)) {
+      mpack_cursor_consume(cursor, next + keylen);
+      return MPACK_OK;
+    }
+
+    /* skip the key and its value */
+    if ((status = mpack_cursor_next(cursor)) ||
+        (status = mpack_cursor_next(cursor))) {
+      return status == MPACK_EOF ? MPACK_ERROR : status;
+    }
+  }
+
+  return MPACK_NOTFOUND;
+}
+
+MPACK_API int mpack_cursor_get_uint(mpack_cursor_t *cursor,
+    mpack_uintmax_t *value)
+{
+  int status;
+  mpack_token_t tok;
+  const char *next;
+
+  if ((status = mpack_cursor_read(cursor, &tok, &next))) return status;
+  if (tok.type != MPACK_TOKEN_UINT) return MPACK_ETYPE;
+  *value = mpack_unpack_uint(tok);
+  mpack_cursor_consume(cursor, next);
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_cursor_get_str(mpack_cursor_t *cursor, const char **str,
+    size_t *len)
+{
+  int status;
+  mpack_token_t tok;
+  const char *next;
+
+  if ((status = mpack_cursor_read(cursor, &tok, &next))) return status;
+  if (tok.type != MPACK_TOKEN_STR) return MPACK_ETYPE;
+  *str = next;
+  *len = tok.length;
+  mpack_cursor_consume(cursor, next + tok.length);
+  return MPACK_OK;
+}
+
+MPACK_API void mpack_extractor_init(mpack_extractor_t *extractor,
+    const mpack_path_t *path, mpack_uint32_t pathlen)
+{
+  mpack_tokbuf_init(&extractor->tokbuf);
+  extractor->path = path;
+  extractor->pathlen = pathlen;
+  extractor->level = 0;
+  extractor->pairs = 0;
+  extractor->skip = 0;
+  extractor->pos = 0;
+  extractor->keypos = 0;
+  extractor->state = MPACK_EXTRACT_VALUE;
+  extractor->match = 0;
+}
+
+/* Walk the next value looking for the path given to mpack_extractor_init,
+ * skipping every value that is not on the path by length. Like mpack_parse,
+ * this can be called again with more data after MPACK_EOF is returned.
+ * Returns MPACK_OK once the whole target value was consumed, with its span
+ * (relative to the first byte ever passed) stored in extractor->span, or
+ * MPACK_NOTFOUND/MPACK_ERROR. */
+MPACK_API int mpack_extractor_run(mpack_extractor_t *extractor,
+    const char **buf, size_t *buflen)
+{
+  int status;
+  size_t initial_buflen = *buflen;
+
+  for (;;) {
+    mpack_token_t tok;
+    mpack_uint32_t items;
+    const mpack_path_t *step = extractor->path + extractor->level;
+
+    if (extractor->state == MPACK_EXTRACT_KEYCMP) {
+      while (extractor->tokbuf.passthrough && *buflen) {
+        mpack_uint32_t n = *buflen < extractor->tokbuf.passthrough ?
+          (mpack_uint32_t)*buflen : extractor->tokbuf.passthrough;
+        if (extractor->match) {
+          extractor->match = !memcmp(*buf, step->key + extractor->keypos, n);
+        }
+        extractor->keypos += n;
+        extractor->tokbuf.passthrough -= n;
+        *buf += n;
+        *buflen -= n;
+      }
+      if (extractor->tokbuf.passthrough) {
+        status = MPACK_EOF;
+        goto end;
+      }
+      if (extractor->match) {
+        extractor->level++;
+        extractor->state = MPACK_EXTRACT_VALUE;
+      } else {
+        /* skip the value associated with the key */
+        extractor->skip = 1;
+        extractor->pairs--;
+        extractor->state = MPACK_EXTRACT_KEY;
+      }
+      continue;
+    }
+
+    if (extractor->skip) {
+      /* mpack_skip also jumps over the payload of the last str/bin/ext read,
+       * counting it as one of the items to skip */
+      if (!*buflen) {
+        status = MPACK_EOF;
+        goto end;
+      }
+      if ((status = mpack_skip(&extractor->tokbuf, buf, buflen,
+              &extractor->skip))) {
+        goto end;
+      }
+    }
+
+    if (extractor->state == MPACK_EXTRACT_DONE) {
+      extractor->span.length = extractor->pos + (initial_buflen - *buflen) -
+        extractor->span.offset;
+      status = MPACK_OK;
+      goto end;
+    }
+
+    if (extractor->state == MPACK_EXTRACT_VALUE &&
+        extractor->level == extractor->pathlen) {
+      extractor->span.offset = extractor->pos + (initial_buflen - *buflen);
+      extractor->state = MPACK_EXTRACT_TARGET;
+    }
+
+    if (extractor->state == MPACK_EXTRACT_KEY && !extractor->pairs) {
+      status = MPACK_NOTFOUND;
+      goto end;
+    }
+
+    if (!*buflen) {
+      status = MPACK_EOF;
+      goto end;
+    }
+
+    if ((status = mpack_read(&extractor->tokbuf, buf, buflen, &tok))) {
+      goto end;
+    }
+
+    if ((status = mpack_children(&tok, &items))) goto end;
+    if (extractor->tokbuf.passthrough) items++;
+
+    switch (extractor->state) {
+      case MPACK_EXTRACT_TARGET:
+        extractor->span.tok = tok;
+        extractor->skip = items;
+        extractor->state = MPACK_EXTRACT_DONE;
+        break;
+      case MPACK_EXTRACT_VALUE:
+        if (step->key) {
+          if (tok.type != MPACK_TOKEN_MAP) {
+            status = MPACK_NOTFOUND;
+            goto end;
+          }
+          extractor->pairs = tok.length;
+          extractor->state = MPACK_EXTRACT_KEY;
+        } else {
+          if (tok.type != MPACK_TOKEN_ARRAY || step->index >= tok.length) {
+            status = MPACK_NOTFOUND;
+            goto end;
+          }
+          extractor->skip = step->index;
+          extractor->level++;
+        }
+        break;
+      default:
+        assert(extractor->state == MPACK_EXTRACT_KEY);
+        if (tok.type == MPACK_TOKEN_STR && tok.length == strlen(step->key)) {
+          extractor->keypos = 0;
+          extractor->match = 1;
+          extractor->state = MPACK_EXTRACT_KEYCMP;
+        } else {
+          /* skip the key's payload or children(if any) and the value */
+          if (items == 0xffffffff) {
+            status = MPACK_ERROR;
+            goto end;
+          }
+          extractor->skip = items + 1;
+          extractor->pairs--;
+        }
+        break;
+    }
+  }
+
+end:
+  extractor->pos += initial_buflen - *buflen;
+  return status;
+}
+
+/* Extract the value at `path` from a fully buffered message. */
+MPACK_API int mpack_extract(const char *buf, size_t buflen,
+    const mpack_path_t *path, mpack_uint32_t pathlen, mpack_span_t *span)
+{
+  int status;
+  mpack_extractor_t extractor;
+  mpack_extractor_init(&extractor, path, pathlen);
+  if (!buflen) return MPACK_EOF;
+  status = mpack_extractor_run(&extractor, &buf, &buflen);
+  if (status == MPACK_OK) *span = extractor.span;
+  return status;
+}
+
+/* Decode the token at the cursor position, setting *next to the first byte
+ * after its header. */
+static int mpack_cursor_read(mpack_cursor_t *cursor, mpack_token_t *tok,
+    const char **next)
+{
+  mpack_tokbuf_t tokbuf;
+  size_t buflen;
+
+  if (cursor->depth && !cursor->frames[cursor->depth].remaining) {
+    return MPACK_EOF;
+  }
+
+  if (cursor->buf == cursor->end) {
+    /* only valid at the top level */
+    return cursor->depth ? MPACK_ERROR : MPACK_EOF;
+  }
+
+  mpack_tokbuf_init(&tokbuf);
+  *next = cursor->buf;
+  buflen = (size_t)(cursor->end - cursor->buf);
+  if (mpack_read(&tokbuf, next, &buflen, tok)) return MPACK_ERROR;
+
+  if (tok->type > MPACK_TOKEN_MAP && buflen < tok->length) {
+    /* truncated payload */
+    return MPACK_ERROR;
+  }
+
+  return MPACK_OK;
+}
+
+static void mpack_cursor_consume(mpack_cursor_t *cursor, const char *next)
+{
+  cursor->buf = next;
+  if (cursor->depth) cursor->frames[cursor->depth].remaining--;
+}
+
+static int mpack_cursor_enter(mpack_cursor_t *cursor, mpack_token_type_t type,
+    mpack_uint32_t *len)
+{
+  int status;
+  mpack_token_t tok;
+  const char *next;
+  mpack_cursor_frame_t *frame;
+
+  if ((status = mpack_cursor_read(cursor, &tok, &next))) return status;
+  if (tok.type != type) return MPACK_ETYPE;
+  if (cursor->depth == MPACK_CURSOR_MAX_DEPTH) return MPACK_NOMEM;
+  if (type == MPACK_TOKEN_MAP && tok.length > 0x7fffffff) return MPACK_ERROR;
+
+  mpack_cursor_consume(cursor, next);
+  frame = cursor->frames + ++cursor->depth;
+  frame->start = next;
+  frame->is_map = type == MPACK_TOKEN_MAP;
+  frame->count = frame->remaining =
+    frame->is_map ? tok.length * 2 : tok.length;
+  *len = tok.length;
+  return MPACK_OK;
+}
+
+/* Number of values following the array/map header in `tok`. */
+static int mpack_children(const mpack_token_t *tok, mpack_uint32_t *items)
+{
+  *items = 0;
+  if (tok->type == MPACK_TOKEN_ARRAY) {
+    *items = tok->length;
+  } else if (tok->type == MPACK_TOKEN_MAP) {
+    if (tok->length > 0x7fffffff) return MPACK_ERROR;
+    *items = tok->length * 2;
+  }
+  return MPACK_OK;
+}
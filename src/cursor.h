@@ -0,0 +1,80 @@
+#ifndef MPACK_CURSOR_H
+#define MPACK_CURSOR_H
+
+#include "core.h"
+#include "object.h"
+#include "rpc.h"
+
+#ifndef MPACK_CURSOR_MAX_DEPTH
+# define MPACK_CURSOR_MAX_DEPTH 32
+#endif
+
+/* Numbered after the rpc codes so every status returned by the library is
+ * distinct. */
+enum {
+  MPACK_NOTFOUND = MPACK_RPC_ERESPID + 1,  /* mpack_cursor_find_key missed */
+  MPACK_ETYPE  /* next value has an unexpected type */
+};
+
+typedef struct mpack_cursor_frame_s {
+  const char *start;  /* first item of the container */
+  mpack_uint32_t count, remaining;  /* items(map keys and values) */
+  int is_map;
+} mpack_cursor_frame_t;
+
+/* Lazy reader over a fully buffered message. Values are only decoded when
+ * requested, everything else is skipped by length. At the top level the
+ * cursor iterates over every value in the buffer. */
+typedef struct mpack_cursor_s {
+  const char *buf, *end;
+  mpack_uint32_t depth;
+  mpack_cursor_frame_t frames[MPACK_CURSOR_MAX_DEPTH + 1];
+} mpack_cursor_t;
+
+/* One step of a path to extract: the value associated with `key` when it is
+ * not NULL, otherwise the item at `index` of an array. */
+typedef struct mpack_path_s {
+  const char *key;
+  mpack_uint32_t index;
+} mpack_path_t;
+
+typedef struct mpack_span_s {
+  size_t offset, length;  /* Bytes of the encoded value */
+  mpack_token_t tok;      /* First token of the value */
+} mpack_span_t;
+
+typedef struct mpack_extractor_s {
+  mpack_tokbuf_t tokbuf;
+  const mpack_path_t *path;
+  mpack_uint32_t pathlen, level, pairs, skip;
+  size_t pos, keypos;
+  int state, match;
+  mpack_span_t span;
+} mpack_extractor_t;
+
+MPACK_API void mpack_cursor_init(mpack_cursor_t *c, const char *b, size_t bl)
+  FUNUSED FNONULL;
+MPACK_API int mpack_cursor_peek(mpack_cursor_t *c, mpack_token_t *tok)
+  FUNUSED FNONULL;
+MPACK_API int mpack_cursor_next(mpack_cursor_t *c) FUNUSED FNONULL;
+MPACK_API int mpack_cursor_enter_array(mpack_cursor_t *c, mpack_uint32_t *l)
+  FUNUSED FNONULL;
+MPACK_API int mpack_cursor_enter_map(mpack_cursor_t *c, mpack_uint32_t *l)
+  FUNUSED FNONULL;
+MPACK_API int mpack_cursor_leave(mpack_cursor_t *c) FUNUSED FNONULL;
+MPACK_API int mpack_cursor_find_key(mpack_cursor_t *c, const char *key)
+  FUNUSED FNONULL;
+MPACK_API int mpack_cursor_get_uint(mpack_cursor_t *c, mpack_uintmax_t *v)
+  FUNUSED FNONULL;
+MPACK_API int mpack_cursor_get_str(mpack_cursor_t *c, const char **s,
+    size_t *l) FUNUSED FNONULL;
+
+
+MPACK_API void mpack_extractor_init(mpack_extractor_t *x,
+    const mpack_path_t *path, mpack_uint32_t pathlen) FUNUSED FNONULL;
+MPACK_API int mpack_extractor_run(mpack_extractor_t *x, const char **b,
+    size_t *bl) FUNUSED FNONULL;
+MPACK_API int mpack_extract(const char *b, size_t bl, const mpack_path_t *path,
+    mpack_uint32_t pathlen, mpack_span_t *span) FUNUSED FNONULL;
+
+#endif  /* MPACK_CURSOR_H */
@@ -0,0 +1,404 @@
+#ifndef MPACK_ENCODE_H
+#define MPACK_ENCODE_H
+
+/* Private to the library sources: not installed, and pasted once into the
+ * amalgamation. The helpers are static(and inline where supported) so
+ * mpack_write and the typed writer get their own inlined copies instead of
+ * calling through the public API.
+ *
+ * The encoders don't check the space left: the caller must ensure
+ * MPACK_MAX_TOKEN_LEN bytes are available. */
+
+#include <string.h>
+
+#include "core.h"
+
+#ifdef __GNUC__
+# define FINLINE __inline__
+#else
+# define FINLINE
+#endif
+
+/* When the compiler provides byte swap builtins, multi-byte values are read
+ * and written with a single (unaligned) load/store plus a byte swap instead of
+ * one byte at a time. C89 builds keep the portable byte loop. */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L && \
+    !defined(FORCE_32BIT_INTS) && !defined(MPACK_NO_BSWAP)
+# define MPACK_BSWAP
+#endif
+
+/* Vector paths for runs of numeric array items, selected from the target
+ * flags: SSE2(baseline on x86-64) and SSSE3 when the compiler targets it. The
+ * scalar loops next to them are the reference and produce the same bytes;
+ * -DMPACK_NO_SIMD builds only those. */
+#if defined(MPACK_BSWAP) && defined(__SSE2__) && !defined(MPACK_NO_SIMD)
+# define MPACK_SSE2
+# include <emmintrin.h>
+# ifdef __SSSE3__
+#  define MPACK_SSSE3
+#  include <tmmintrin.h>
+# endif
+#endif
+
+static FINLINE int mpack_wpint(char **b, size_t *bl, mpack_value_t v)
+  FUNUSED;
+static FINLINE int mpack_wnint(char **b, size_t *bl, mpack_value_t v)
+  FUNUSED;
+static FINLINE int mpack_wstr(char **b, size_t *bl, mpack_uint32_t len)
+  FUNUSED;
+static FINLINE int mpack_wbin(char **b, size_t *bl, mpack_uint32_t len)
+  FUNUSED;
+static FINLINE int mpack_warray(char **b, size_t *bl, mpack_uint32_t len)
+  FUNUSED;
+static FINLINE int mpack_wmap(char **b, size_t *bl, mpack_uint32_t len)
+  FUNUSED;
+static FINLINE int mpack_wfloat(char **b, size_t *bl,
+    const mpack_token_t *tok) FUNUSED;
+static FINLINE int mpack_w1(char **b, size_t *bl, mpack_uint32_t v) FUNUSED;
+#ifndef MPACK_BSWAP
+static FINLINE int mpack_w2(char **b, size_t *bl, mpack_uint32_t v) FUNUSED;
+static FINLINE int mpack_w4(char **b, size_t *bl, mpack_uint32_t v) FUNUSED;
+#endif
+static FINLINE int mpack_wh1(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t v) FUNUSED;
+static FINLINE int mpack_wh2(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t v) FUNUSED;
+static FINLINE int mpack_wh4(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t v) FUNUSED;
+static FINLINE int mpack_wh8(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t hi, mpack_uint32_t lo) FUNUSED;
+#ifndef MPACK_NATIVE64
+static FINLINE int mpack_nonneg(mpack_value_t v) FUNUSED;
+#endif
+#ifdef MPACK_BSWAP
+static FINLINE void mpack_store16(char *p, mpack_uint32_t v) FUNUSED;
+static FINLINE void mpack_store32(char *p, mpack_uint32_t v) FUNUSED;
+static FINLINE void mpack_store64(char *p, unsigned long long v) FUNUSED;
+static FINLINE mpack_uint32_t mpack_load16(const char *p) FUNUSED;
+static FINLINE mpack_uint32_t mpack_load32(const char *p) FUNUSED;
+static FINLINE unsigned long long mpack_load64(const char *p) FUNUSED;
+#endif
+
+static FINLINE int mpack_wpint(char **buf, size_t *buflen, mpack_value_t val)
+{
+#ifdef MPACK_NATIVE64
+  mpack_uint64_t v = val.u;
+
+  if (v > 0xffffffff) {
+    /* uint 64 */
+    return mpack_wh8(buf, buflen, 0xcf, (mpack_uint32_t)(v >> 32),
+                     (mpack_uint32_t)v);
+  } else if (v > 0xffff) {
+    /* uint 32 */
+    return mpack_wh4(buf, buflen, 0xce, (mpack_uint32_t)v);
+  } else if (v > 0xff) {
+    /* uint 16 */
+    return mpack_wh2(buf, buflen, 0xcd, (mpack_uint32_t)v);
+  } else if (v > 0x7f) {
+    /* uint 8 */
+    return mpack_wh1(buf, buflen, 0xcc, (mpack_uint32_t)v);
+  } else {
+    return mpack_w1(buf, buflen, (mpack_uint32_t)v);
+  }
+#else
+  mpack_uint32_t hi = val.hi;
+  mpack_uint32_t lo = val.lo;
+
+  if (hi) {
+    /* uint 64 */
+    return mpack_wh8(buf, buflen, 0xcf, hi, lo);
+  } else if (lo > 0xffff) {
+    /* uint 32 */
+    return mpack_wh4(buf, buflen, 0xce, lo);
+  } else if (lo > 0xff) {
+    /* uint 16 */
+    return mpack_wh2(buf, buflen, 0xcd, lo);
+  } else if (lo > 0x7f) {
+    /* uint 8 */
+    return mpack_wh1(buf, buflen, 0xcc, lo);
+  } else {
+    return mpack_w1(buf, buflen, lo);
+  }
+#endif
+}
+
+static FINLINE int mpack_wnint(char **buf, size_t *buflen, mpack_value_t val)
+{
+#ifdef MPACK_NATIVE64
+  mpack_sint64_t v = val.i;
+  mpack_uint32_t lo = (mpack_uint32_t)val.u;
+
+  if (v >= 0) {
+    return mpack_wpint(buf, buflen, val);
+  } else if (v < -0x7fffffffll - 1) {
+    /* int 64 */
+    return mpack_wh8(buf, buflen, 0xd3, (mpack_uint32_t)(val.u >> 32), lo);
+  } else if (v < -0x8000) {
+    /* int 32 */
+    return mpack_wh4(buf, buflen, 0xd2, lo);
+  } else if (v < -0x80) {
+    /* int 16 */
+    return mpack_wh2(buf, buflen, 0xd1, lo);
+  } else if (v < -0x20) {
+    /* int 8 */
+    return mpack_wh1(buf, buflen, 0xd0, lo);
+  } else {
+    /* negative fixint */
+    return mpack_w1(buf, buflen, lo);
+  }
+#else
+  mpack_uint32_t hi = val.hi;
+  mpack_uint32_t lo = val.lo;
+
+  if (mpack_nonneg(val)) {
+    return mpack_wpint(buf, buflen, val);
+  } else if ((hi && hi != 0xffffffff) || lo < 0x80000000) {
+    /* int 64 */
+    return mpack_wh8(buf, buflen, 0xd3, hi, lo);
+  } else if (lo < 0xffff8000) {
+    /* int 32 */
+    return mpack_wh4(buf, buflen, 0xd2, lo);
+  } else if (lo < 0xffffff80) {
+    /* int 16 */
+    return mpack_wh2(buf, buflen, 0xd1, lo);
+  } else if (lo < 0xffffffe0) {
+    /* int 8 */
+    return mpack_wh1(buf, buflen, 0xd0, lo);
+  } else {
+    /* negative fixint */
+    return mpack_w1(buf, buflen, (mpack_uint32_t)(0x100 + lo));
+  }
+#endif
+}
+
+static FINLINE int mpack_wstr(char **buf, size_t *buflen, mpack_uint32_t len)
+{
+  if (len < 0x20) {
+    return mpack_w1(buf, buflen, 0xa0 | len);
+  } else if (len < 0x100) {
+    return mpack_wh1(buf, buflen, 0xd9, len);
+  } else if (len < 0x10000) {
+    return mpack_wh2(buf, buflen, 0xda, len);
+  } else {
+    return mpack_wh4(buf, buflen, 0xdb, len);
+  }
+}
+
+static FINLINE int mpack_wbin(char **buf, size_t *buflen, mpack_uint32_t len)
+{
+  if (len < 0x100) {
+    return mpack_wh1(buf, buflen, 0xc4, len);
+  } else if (len < 0x10000) {
+    return mpack_wh2(buf, buflen, 0xc5, len);
+  } else {
+    return mpack_wh4(buf, buflen, 0xc6, len);
+  }
+}
+
+static FINLINE int mpack_warray(char **buf, size_t *buflen, mpack_uint32_t len)
+{
+  if (len < 0x10) {
+    return mpack_w1(buf, buflen, 0x90 | len);
+  } else if (len < 0x10000) {
+    return mpack_wh2(buf, buflen, 0xdc, len);
+  } else {
+    return mpack_wh4(buf, buflen, 0xdd, len);
+  }
+}
+
+static FINLINE int mpack_wmap(char **buf, size_t *buflen, mpack_uint32_t len)
+{
+  if (len < 0x10) {
+    return mpack_w1(buf, buflen, 0x80 | len);
+  } else if (len < 0x10000) {
+    return mpack_wh2(buf, buflen, 0xde, len);
+  } else {
+    return mpack_wh4(buf, buflen, 0xdf, len);
+  }
+}
+
+static FINLINE int mpack_w1(char **b, size_t *bl, mpack_uint32_t v)
+{
+  (*bl)--;
+  *(*b)++ = (char)(v & 0xff);
+  return MPACK_OK;
+}
+
+/* Type code `c` followed by the 2/4 byte big-endian `v`, see mpack_wh1. */
+static FINLINE int mpack_wh2(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t v)
+{
+#ifdef MPACK_BSWAP
+  **b = (char)(c & 0xff);
+  mpack_store16(*b + 1, v);
+  *b += 3;
+  *bl -= 3;
+  return MPACK_OK;
+#else
+  return mpack_w1(b, bl, c) || mpack_w2(b, bl, v);
+#endif
+}
+
+static FINLINE int mpack_wh4(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t v)
+{
+#ifdef MPACK_BSWAP
+  **b = (char)(c & 0xff);
+  mpack_store32(*b + 1, v);
+  *b += 5;
+  *bl -= 5;
+  return MPACK_OK;
+#else
+  return mpack_w1(b, bl, c) || mpack_w4(b, bl, v);
+#endif
+}
+
+/* Float tokens have a length of 4 or 8 */
+static FINLINE int mpack_wfloat(char **buf, size_t *buflen,
+    const mpack_token_t *tok)
+{
+#ifdef MPACK_NATIVE64
+  if (tok->length == 4) {
+    union {
+      float f;
+      mpack_uint32_t m;
+    } conv;
+    conv.f = (float)tok->data.value.d;
+    return mpack_wh4(buf, buflen, 0xca, conv.m);
+  } else if (tok->length == 8) {
+    return mpack_wh8(buf, buflen, 0xcb,
+                     (mpack_uint32_t)(tok->data.value.u >> 32),
+                     (mpack_uint32_t)tok->data.value.u);
+  } else {
+#else
+  if (tok->length == 4) {
+    return mpack_wh4(buf, buflen, 0xca, tok->data.value.lo);
+  } else if (tok->length == 8) {
+    return mpack_wh8(buf, buflen, 0xcb, tok->data.value.hi,
+                     tok->data.value.lo);
+  } else {
+#endif
+    return MPACK_ERROR;
+  }
+}
+
+#ifndef MPACK_BSWAP
+static FINLINE int mpack_w2(char **b, size_t *bl, mpack_uint32_t v)
+{
+  *bl -= 2;
+  *(*b)++ = (char)((v >> 8) & 0xff);
+  *(*b)++ = (char)(v & 0xff);
+  return MPACK_OK;
+}
+
+static FINLINE int mpack_w4(char **b, size_t *bl, mpack_uint32_t v)
+{
+  *bl -= 4;
+  *(*b)++ = (char)((v >> 24) & 0xff);
+  *(*b)++ = (char)((v >> 16) & 0xff);
+  *(*b)++ = (char)((v >> 8) & 0xff);
+  *(*b)++ = (char)(v & 0xff);
+  return MPACK_OK;
+}
+#endif
+
+/* Headers made of a type code followed by a 1/2/4/8 byte big-endian value.
+ * With MPACK_BSWAP the value is byte swapped in a register and written with a
+ * single store instead of one byte at a time. */
+static FINLINE int mpack_wh1(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t v)
+{
+#ifdef MPACK_BSWAP
+  mpack_store16(*b, ((c & 0xff) << 8) | (v & 0xff));
+  *b += 2;
+  *bl -= 2;
+  return MPACK_OK;
+#else
+  return mpack_w1(b, bl, c) || mpack_w1(b, bl, v);
+#endif
+}
+
+static FINLINE int mpack_wh8(char **b, size_t *bl, mpack_uint32_t c,
+    mpack_uint32_t hi, mpack_uint32_t lo)
+{
+#ifdef MPACK_BSWAP
+  **b = (char)(c & 0xff);
+  mpack_store64(*b + 1, (unsigned long long)hi << 32 | lo);
+  *b += 9;
+  *bl -= 9;
+  return MPACK_OK;
+#else
+  return mpack_w1(b, bl, c) || mpack_w4(b, bl, hi) || mpack_w4(b, bl, lo);
+#endif
+}
+
+#ifndef MPACK_NATIVE64
+/* Whether a SINT value is non-negative. hi is 0 for values packed from 32-bit
+ * integers, so the sign is taken from lo in that case. */
+static FINLINE int mpack_nonneg(mpack_value_t v)
+{
+  return v.hi ? v.hi < 0x80000000 : v.lo < 0x80000000;
+}
+#endif
+
+#ifdef MPACK_BSWAP
+/* Big-endian stores, the caller must ensure the buffer has enough space. */
+static FINLINE void mpack_store16(char *p, mpack_uint32_t v)
+{
+  unsigned short s = (unsigned short)v;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  s = __builtin_bswap16(s);
+#endif
+  memcpy(p, &s, sizeof(s));
+}
+
+static FINLINE void mpack_store32(char *p, mpack_uint32_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  memcpy(p, &v, sizeof(v));
+}
+
+static FINLINE void mpack_store64(char *p, unsigned long long v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  memcpy(p, &v, sizeof(v));
+}
+
+/* Big-endian loads, the caller must ensure the buffer has enough data. */
+static FINLINE mpack_uint32_t mpack_load16(const char *p)
+{
+  unsigned short v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap16(v);
+#endif
+  return v;
+}
+
+static FINLINE mpack_uint32_t mpack_load32(const char *p)
+{
+  mpack_uint32_t v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static FINLINE unsigned long long mpack_load64(const char *p)
+{
+  unsigned long long v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+#endif
+
+#endif  /* MPACK_ENCODE_H */
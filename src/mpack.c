@@ -2,3 +2,7 @@
 #include "conv.c"
 #include "object.c"
 #include "rpc.c"
+#include "tape.c"
+#include "cursor.c"
+#include "query.c"
+#include "writer.c"
@@ -3,8 +3,17 @@
 #include "object.h"
 
 static int mpack_parser_full(mpack_parser_t *w);
-static mpack_node_t *mpack_parser_push(mpack_parser_t *w);
-static mpack_node_t *mpack_parser_pop(mpack_parser_t *w);
+static int mpack_cparser_full(mpack_cparser_t *w);
+static mpack_cnode_t *mpack_cparser_push(mpack_cparser_t *w);
+static mpack_cnode_t *mpack_cparser_pop(mpack_cparser_t *w);
+static int mpack_dparser_full(mpack_dparser_t *w);
+static mpack_node_t *mpack_dparser_push(mpack_dparser_t *w);
+static mpack_node_t *mpack_dparser_pop(mpack_dparser_t *w);
+static void mpack_chunk_init(mpack_node_t *header, mpack_uint32_t count,
+    mpack_node_t *prev);
+static void mpack_node_init(mpack_node_t *node);
+static int mpack_node_done(mpack_node_t *top, mpack_node_t *parent);
+static int mpack_cnode_done(mpack_cnode_t *top, mpack_cnode_t *parent);
 
 MPACK_API void mpack_parser_init(mpack_parser_t *parser,
     mpack_uint32_t capacity)
@@ -14,7 +23,7 @@ MPACK_API void mpack_parser_init(mpack_parser_t *parser,
   parser->capacity = capacity ? capacity : MPACK_MAX_OBJECT_DEPTH;
   parser->size = 0;
   parser->exiting = 0;
-  memset(parser->items, 0, sizeof(mpack_node_t) * (parser->capacity + 1));
+  /* nodes are initialized when pushed, only the sentinel is needed */
   parser->items[0].pos = (size_t)-1;
   parser->status = 0;
 }
@@ -26,13 +35,13 @@ MPACK_API void mpack_parser_init(mpack_parser_t *parser,
     }                                                                       \
   } while (0)
 
-#define MPACK_WALK(action)                                                  \
+#define MPACK_WALK(node_t, full, push, pop, action)                         \
   do {                                                                      \
-    mpack_node_t *n;                                                        \
+    node_t *n;                                                              \
                                                                             \
     if (parser->exiting) goto exit;                                         \
-    if (mpack_parser_full(parser)) return MPACK_NOMEM;                      \
-    n = mpack_parser_push(parser);                                          \
+    if (full(parser)) return MPACK_NOMEM;                                   \
+    n = push(parser);                                                       \
     action;                                                                 \
     MPACK_EXCEPTION_CHECK(parser);                                              \
     parser->exiting = 1;                                                    \
@@ -40,7 +49,7 @@ MPACK_API void mpack_parser_init(mpack_parser_t *parser,
                                                                             \
 exit:                                                                       \
     parser->exiting = 0;                                                    \
-    while ((n = mpack_parser_pop(parser))) {                                \
+    while ((n = pop(parser))) {                                             \
       exit_cb(parser, n);                                                   \
       MPACK_EXCEPTION_CHECK(parser);                                            \
       if (!parser->size) return MPACK_OK;                                   \
@@ -53,72 +62,170 @@ MPACK_API int mpack_parse_tok(mpack_parser_t *parser, mpack_token_t tok,
     mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
 {
   MPACK_EXCEPTION_CHECK(parser);
-  MPACK_WALK({n->tok = tok; enter_cb(parser, n);});
+  MPACK_WALK(mpack_node_t, mpack_parser_full, mpack_parser_push, mpack_parser_pop,
+      {n->tok = tok; enter_cb(parser, n);});
 }
 
 MPACK_API int mpack_unparse_tok(mpack_parser_t *parser, mpack_token_t *tok,
     mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
 {
   MPACK_EXCEPTION_CHECK(parser);
-  MPACK_WALK({enter_cb(parser, n); *tok = n->tok;});
+  MPACK_WALK(mpack_node_t, mpack_parser_full, mpack_parser_push, mpack_parser_pop,
+      {enter_cb(parser, n); *tok = n->tok;});
 }
 
+/* Read tokens from buf and feed them to parse_tok until an object is
+ * complete or buf is exhausted. */
+#define MPACK_PARSE(parse_tok)                                              \
+  do {                                                                      \
+    int status = MPACK_EOF;                                                 \
+    MPACK_EXCEPTION_CHECK(parser);                                          \
+                                                                            \
+    while (*buflen && status) {                                             \
+      mpack_token_t tok;                                                    \
+      mpack_tokbuf_t *tb = &parser->tokbuf;                                 \
+      const char *buf_save = *buf;                                          \
+      size_t buflen_save = *buflen;                                         \
+                                                                            \
+      if ((status = mpack_read(tb, buf, buflen, &tok)) == MPACK_EOF)        \
+        continue;                                                           \
+      else if (status == MPACK_ERROR)                                       \
+        goto rollback;                                                      \
+                                                                            \
+      do {                                                                  \
+        status = parse_tok(parser, tok, enter_cb, exit_cb);                 \
+        MPACK_EXCEPTION_CHECK(parser);                                      \
+      } while (parser->exiting);                                            \
+                                                                            \
+      if (status != MPACK_NOMEM) continue;                                  \
+                                                                            \
+rollback:                                                                   \
+      /* restore buf/buflen so the next call will try to read the same      \
+       * token */                                                           \
+      *buf = buf_save;                                                      \
+      *buflen = buflen_save;                                                \
+      break;                                                                \
+    }                                                                       \
+                                                                            \
+    return status;                                                          \
+  } while (0)
+
+/* Write the tokens produced by unparse_tok to buf until an object is
+ * complete or buf is full. */
+#define MPACK_UNPARSE(unparse_tok)                                          \
+  do {                                                                      \
+    int status = MPACK_EOF;                                                 \
+    MPACK_EXCEPTION_CHECK(parser);                                          \
+                                                                            \
+    while (*buflen && status) {                                             \
+      int write_status;                                                     \
+      mpack_token_t tok;                                                    \
+      mpack_tokbuf_t *tb = &parser->tokbuf;                                 \
+                                                                            \
+      if (!tb->plen)                                                        \
+        parser->status = unparse_tok(parser, &tok, enter_cb, exit_cb);      \
+                                                                            \
+      MPACK_EXCEPTION_CHECK(parser);                                        \
+                                                                            \
+      status = parser->status;                                              \
+                                                                            \
+      if (status == MPACK_NOMEM)                                            \
+        break;                                                              \
+                                                                            \
+      if (parser->exiting) {                                                \
+        write_status = mpack_write(tb, buf, buflen, &tok);                  \
+        status = write_status ? write_status : status;                      \
+      }                                                                     \
+    }                                                                       \
+                                                                            \
+    return status;                                                          \
+  } while (0)
+
 MPACK_API int mpack_parse(mpack_parser_t *parser, const char **buf,
     size_t *buflen, mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
 {
-  int status = MPACK_EOF;
-  MPACK_EXCEPTION_CHECK(parser);
+  MPACK_PARSE_LOOP(enter_cb, exit_cb);
+}
 
-  while (*buflen && status) {
-    mpack_token_t tok;
-    mpack_tokbuf_t *tb = &parser->tokbuf;
-    const char *buf_save = *buf;
-    size_t buflen_save = *buflen;
+MPACK_API int mpack_unparse(mpack_parser_t *parser, char **buf, size_t *buflen,
+    mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
+{
+  MPACK_UNPARSE(mpack_unparse_tok);
+}
 
-    if ((status = mpack_read(tb, buf, buflen, &tok)) == MPACK_EOF) continue;
-    else if (status == MPACK_ERROR) goto rollback;
+/* Pull-style alternative to mpack_parse: produce the next event, in the same
+ * order mpack_parse invokes enter_cb/exit_cb. Returns MPACK_OK when *ev was
+ * filled, MPACK_EOF if buf was exhausted before the next token was complete,
+ * MPACK_ERROR for invalid input(buf is left untouched) and MPACK_NOMEM when
+ * the parser is full. An object is complete after the MPACK_EVENT_EXIT with
+ * depth 1. The node in *ev remains valid until its MPACK_EVENT_EXIT. */
+MPACK_API int mpack_next_event(mpack_parser_t *parser, const char **buf,
+    size_t *buflen, mpack_event_t *ev)
+{
+  int status;
+  mpack_token_t tok;
+  mpack_node_t *n;
+  const char *buf_save = *buf;
+  size_t buflen_save = *buflen;
 
-    do {
-      status = mpack_parse_tok(parser, tok, enter_cb, exit_cb);
-      MPACK_EXCEPTION_CHECK(parser);
-    } while (parser->exiting);
+  if (parser->exiting) {
+    if ((n = mpack_parser_pop(parser))) {
+      ev->type = MPACK_EVENT_EXIT;
+      ev->node = n;
+      ev->parent = MPACK_PARENT_NODE(n);
+      ev->depth = parser->size + 1;
+      parser->exiting = parser->size != 0;
+      return MPACK_OK;
+    }
+    parser->exiting = 0;
+  }
 
-    if (status != MPACK_NOMEM) continue;
+  if (mpack_parser_full(parser)) return MPACK_NOMEM;
+  if (!*buflen) return MPACK_EOF;
 
-rollback:
-    /* restore buf/buflen so the next call will try to read the same token */
-    *buf = buf_save;
-    *buflen = buflen_save;
-    break;
+  if ((status = mpack_read(&parser->tokbuf, buf, buflen, &tok))) {
+    if (status == MPACK_ERROR) {
+      *buf = buf_save;
+      *buflen = buflen_save;
+    }
+    return status;
   }
 
-  return status;
+  n = mpack_parser_push(parser);
+  n->tok = tok;
+  ev->type = MPACK_EVENT_ENTER;
+  ev->node = n;
+  ev->parent = MPACK_PARENT_NODE(n);
+  ev->depth = parser->size;
+  parser->exiting = 1;
+  return MPACK_OK;
 }
 
-MPACK_API int mpack_unparse(mpack_parser_t *parser, char **buf, size_t *buflen,
+/* Walk an object like mpack_unparse, storing the exact number of bytes it
+ * would write in *size. The parser must be initialized again before the
+ * object is unparsed. Returns MPACK_ERROR if an invalid token is visited. */
+MPACK_API int mpack_unparse_size(mpack_parser_t *parser, size_t *size,
     mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
 {
   int status = MPACK_EOF;
   MPACK_EXCEPTION_CHECK(parser);
 
-  while (*buflen && status) {
-    int write_status;
+  *size = 0;
+  while (status) {
     mpack_token_t tok;
-    mpack_tokbuf_t *tb = &parser->tokbuf;
-
-    if (!tb->plen)
-      parser->status = mpack_unparse_tok(parser, &tok, enter_cb, exit_cb);
+    size_t toksize;
 
+    parser->status = mpack_unparse_tok(parser, &tok, enter_cb, exit_cb);
     MPACK_EXCEPTION_CHECK(parser);
-
     status = parser->status;
 
     if (status == MPACK_NOMEM)
       break;
 
     if (parser->exiting) {
-      write_status = mpack_write(tb, buf, buflen, &tok);
-      status = write_status ? write_status : status;
+      toksize = mpack_token_size(&tok);
+      if (!toksize && tok.type != MPACK_TOKEN_CHUNK) return MPACK_ERROR;
+      *size += toksize;
     }
   }
 
@@ -135,61 +242,314 @@ MPACK_API void mpack_parser_copy(mpack_parser_t *dst, mpack_parser_t *src)
   /* reset capacity */
   dst->capacity = dst_capacity;
   /* copy the stack */
-  for (i = 0; i <= src->capacity; i++) {
+  for (i = 0; i <= src->size; i++) {
     dst->items[i] = src->items[i];
   }
 }
 
+MPACK_API mpack_node_t *mpack_parser_push(mpack_parser_t *parser)
+{
+  mpack_node_t *top;
+  assert(parser->size < parser->capacity);
+  top = parser->items + parser->size + 1;
+  mpack_node_init(top);
+  /* increase size and invoke callback, passing parent node if any */
+  parser->size++;
+  return top;
+}
+
+MPACK_API mpack_node_t *mpack_parser_pop(mpack_parser_t *parser)
+{
+  mpack_node_t *top;
+  assert(parser->size);
+  top = parser->items + parser->size;
+
+  if (!mpack_node_done(top, MPACK_PARENT_NODE(top))) return NULL;
+
+  parser->size--;
+  return top;
+}
+
+/* Initialize a parser with a compact stack of `capacity` nodes and `slots`
+ * user data items per node. Pass 0 for the limits of mpack_cparser_t. */
+MPACK_API void mpack_cparser_init(mpack_cparser_t *parser,
+    mpack_uint32_t capacity, mpack_uint32_t slots)
+{
+  mpack_tokbuf_init(&parser->tokbuf);
+  parser->data.p = NULL;
+  parser->capacity = capacity ? capacity : MPACK_MAX_OBJECT_DEPTH;
+  parser->slots = slots ? slots : 1;
+  parser->size = 0;
+  parser->exiting = 0;
+  parser->status = 0;
+}
+
+MPACK_API int mpack_cparse_tok(mpack_cparser_t *parser, mpack_token_t tok,
+    mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+{
+  MPACK_EXCEPTION_CHECK(parser);
+  MPACK_WALK(mpack_cnode_t, mpack_cparser_full, mpack_cparser_push,
+      mpack_cparser_pop, {
+        n->type = (unsigned)tok.type & 0xff;
+        n->length = tok.length;
+        parser->tok = tok;
+        enter_cb(parser, n);
+      });
+}
+
+MPACK_API int mpack_cunparse_tok(mpack_cparser_t *parser, mpack_token_t *tok,
+    mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+{
+  MPACK_EXCEPTION_CHECK(parser);
+  MPACK_WALK(mpack_cnode_t, mpack_cparser_full, mpack_cparser_push,
+      mpack_cparser_pop, {
+        enter_cb(parser, n);
+        n->type = (unsigned)parser->tok.type & 0xff;
+        n->length = parser->tok.length;
+        *tok = parser->tok;
+      });
+}
+
+MPACK_API int mpack_cparse(mpack_cparser_t *parser, const char **buf,
+    size_t *buflen, mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+{
+  MPACK_PARSE(mpack_cparse_tok);
+}
+
+MPACK_API int mpack_cunparse(mpack_cparser_t *parser, char **buf,
+    size_t *buflen, mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+{
+  MPACK_UNPARSE(mpack_cunparse_tok);
+}
+
+/* Initialize a parser with a growable node stack. If `items` is not NULL, its
+ * `count` nodes are used as the first chunk(and are not freed by
+ * mpack_dparser_destroy). More chunks are requested from `alloc`(which may be
+ * NULL to only use `items`), each twice as large as the previous one. A
+ * `max_depth` of 0 means there's no depth limit besides available memory.
+ * When the stack can't grow, mpack_dparse and friends return MPACK_NOMEM and
+ * can be called again after more memory is available. */
+MPACK_API void mpack_dparser_init(mpack_dparser_t *parser, mpack_node_t *items,
+    mpack_uint32_t count, mpack_uint32_t max_depth, mpack_alloc_fn alloc,
+    void *ud)
+{
+  mpack_tokbuf_init(&parser->tokbuf);
+  parser->data.p = NULL;
+  parser->size = 0;
+  parser->max_depth = max_depth;
+  parser->status = 0;
+  parser->exiting = 0;
+  parser->alloc = alloc;
+  parser->ud = ud;
+  /* the first item is the chunk header, so at least 2 are needed */
+  parser->items = items && count > 1 ? items : NULL;
+  parser->first = parser->chunk = parser->top = parser->items;
+  if (parser->items) mpack_chunk_init(parser->items, count, NULL);
+}
+
+MPACK_API void mpack_dparser_destroy(mpack_dparser_t *parser)
+{
+  mpack_node_t *chunk = parser->first;
+
+  while (chunk) {
+    mpack_node_t *next = chunk->data[1].p;
+    if (chunk != parser->items) {
+      parser->alloc(parser->ud, chunk, sizeof(mpack_node_t) * chunk->tok.length,
+          0);
+    }
+    chunk = next;
+  }
+
+  parser->first = parser->chunk = parser->top = parser->items = NULL;
+  parser->size = 0;
+}
+
+MPACK_API int mpack_dparse_tok(mpack_dparser_t *parser, mpack_token_t tok,
+    mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+{
+  MPACK_EXCEPTION_CHECK(parser);
+  MPACK_WALK(mpack_node_t, mpack_dparser_full, mpack_dparser_push, mpack_dparser_pop,
+      {n->tok = tok; enter_cb(parser, n);});
+}
+
+MPACK_API int mpack_dunparse_tok(mpack_dparser_t *parser, mpack_token_t *tok,
+    mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+{
+  MPACK_EXCEPTION_CHECK(parser);
+  MPACK_WALK(mpack_node_t, mpack_dparser_full, mpack_dparser_push, mpack_dparser_pop,
+      {enter_cb(parser, n); *tok = n->tok;});
+}
+
+MPACK_API int mpack_dparse(mpack_dparser_t *parser, const char **buf,
+    size_t *buflen, mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+{
+  MPACK_PARSE(mpack_dparse_tok);
+}
+
+MPACK_API int mpack_dunparse(mpack_dparser_t *parser, char **buf,
+    size_t *buflen, mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+{
+  MPACK_UNPARSE(mpack_dunparse_tok);
+}
+
 static int mpack_parser_full(mpack_parser_t *parser)
 {
   return parser->size == parser->capacity;
 }
 
-static mpack_node_t *mpack_parser_push(mpack_parser_t *parser)
+static int mpack_cparser_full(mpack_cparser_t *parser)
 {
-  mpack_node_t *top;
+  return parser->size == parser->capacity;
+}
+
+static mpack_cnode_t *mpack_cparser_push(mpack_cparser_t *parser)
+{
+  mpack_cnode_t *top;
+  mpack_data_t *data;
+  mpack_uint32_t i;
   assert(parser->size < parser->capacity);
-  top = parser->items + parser->size + 1;
-  top->data[0].p = NULL;
-  top->data[1].p = NULL;
+  top = MPACK_CPARSER_ITEMS(parser) + parser->size;
   top->pos = 0;
   top->key_visited = 0;
-  /* increase size and invoke callback, passing parent node if any */
+  data = MPACK_CNODE_DATA(parser, top);
+  for (i = 0; i < parser->slots; i++) data[i].p = NULL;
   parser->size++;
   return top;
 }
 
-static mpack_node_t *mpack_parser_pop(mpack_parser_t *parser)
+static mpack_cnode_t *mpack_cparser_pop(mpack_cparser_t *parser)
 {
-  mpack_node_t *top, *parent;
+  mpack_cnode_t *top;
   assert(parser->size);
-  top = parser->items + parser->size;
+  top = MPACK_CPARSER_ITEMS(parser) + parser->size - 1;
 
-  if (top->tok.type > MPACK_TOKEN_CHUNK && top->pos < top->tok.length) {
-    /* continue processing children */
-    return NULL;
-  }
+  if (!mpack_cnode_done(top, MPACK_CPARENT_NODE(parser, top))) return NULL;
+
+  parser->size--;
+  return top;
+}
+
+/* Make sure there's room to push a node, allocating a new chunk if the
+ * current one is full. */
+static int mpack_dparser_full(mpack_dparser_t *parser)
+{
+  mpack_node_t *chunk = parser->chunk, *next;
+  mpack_uint32_t count = MPACK_DPARSER_MIN_CHUNK;
+
+  if (parser->max_depth && parser->size == parser->max_depth) return 1;
 
-  parent = MPACK_PARENT_NODE(top);
-  if (parent) {
-    /* we use parent->tok.length to keep track of how many children remain.
-     * update it to reflect the processed node. */
-    if (top->tok.type == MPACK_TOKEN_CHUNK) {
-      parent->pos += top->tok.length;
-    } else if (parent->tok.type == MPACK_TOKEN_MAP) {
-      /* maps allow up to 2^32 - 1 pairs, so to allow this many items in a
-       * 32-bit length variable we use an additional flag to determine if the
-       * key of a certain position was visited */
-      if (parent->key_visited) {
-        parent->pos++;
-      }
-      parent->key_visited = !parent->key_visited;
-    } else {
-      parent->pos++;
+  if (chunk) {
+    if (parser->top < chunk + chunk->tok.length - 1 || chunk->data[1].p) {
+      return 0;
     }
+    /* stop doubling when chunks reach 64k nodes */
+    count = chunk->tok.length;
+    if (count < 0x10000) count *= 2;
+  }
+
+  if (!parser->alloc
+      || !(next = parser->alloc(parser->ud, NULL, 0,
+          sizeof(mpack_node_t) * count))) {
+    return 1;
+  }
+
+  mpack_chunk_init(next, count, chunk);
+  if (!chunk) parser->first = parser->chunk = parser->top = next;
+  return 0;
+}
+
+static mpack_node_t *mpack_dparser_push(mpack_dparser_t *parser)
+{
+  mpack_node_t *chunk = parser->chunk;
+
+  if (parser->top == chunk + chunk->tok.length - 1) {
+    /* continue on the next chunk, reserved by mpack_dparser_full */
+    parser->chunk = chunk = chunk->data[1].p;
+    parser->top = chunk + 1;
+  } else {
+    parser->top++;
+  }
+
+  mpack_node_init(parser->top);
+  parser->size++;
+  return parser->top;
+}
+
+static mpack_node_t *mpack_dparser_pop(mpack_dparser_t *parser)
+{
+  mpack_node_t *top = parser->top, *chunk = parser->chunk;
+  assert(parser->size);
+
+  if (!mpack_node_done(top, MPACK_DPARENT_NODE(top))) return NULL;
+
+  if (top == chunk + 1 && chunk != parser->first) {
+    /* back to the last node of the previous chunk */
+    parser->chunk = chunk = chunk->data[0].p;
+    parser->top = chunk + chunk->tok.length - 1;
+  } else {
+    parser->top--;
   }
 
   parser->size--;
   return top;
 }
 
+static void mpack_chunk_init(mpack_node_t *header, mpack_uint32_t count,
+    mpack_node_t *prev)
+{
+  header->tok.length = count;
+  /* the first header is a sentinel like items[0] of mpack_parser_t */
+  header->pos = prev ? (size_t)-2 : (size_t)-1;
+  header->data[0].p = prev;
+  header->data[1].p = NULL;
+  if (prev) prev->data[1].p = header;
+}
+
+static void mpack_node_init(mpack_node_t *node)
+{
+  node->data[0].p = NULL;
+  node->data[1].p = NULL;
+  node->pos = 0;
+  node->key_visited = 0;
+}
+
+/* Evaluates to 0 if `top` still has children to process, else updates the
+ * parent to reflect the processed node and evaluates to 1. `type`/`length`
+ * name the token fields of the node type. */
+#define MPACK_NODE_DONE(top, parent, type, length)                          \
+  do {                                                                      \
+    if (top->type > MPACK_TOKEN_CHUNK && top->pos < top->length) {          \
+      /* continue processing children */                                    \
+      return 0;                                                             \
+    }                                                                       \
+                                                                            \
+    if (parent) {                                                           \
+      /* we use parent->length to keep track of how many children remain.   \
+       * update it to reflect the processed node. */                        \
+      if (top->type == MPACK_TOKEN_CHUNK) {                                 \
+        parent->pos += top->length;                                         \
+      } else if (parent->type == MPACK_TOKEN_MAP) {                         \
+        /* maps allow up to 2^32 - 1 pairs, so to allow this many items in  \
+         * a 32-bit length variable we use an additional flag to determine \
+         * if the key of a certain position was visited */                  \
+        if (parent->key_visited) {                                          \
+          parent->pos++;                                                    \
+        }                                                                   \
+        parent->key_visited = !parent->key_visited;                         \
+      } else {                                                              \
+        parent->pos++;                                                      \
+      }                                                                     \
+    }                                                                       \
+                                                                            \
+    return 1;                                                               \
+  } while (0)
+
+static int mpack_node_done(mpack_node_t *top, mpack_node_t *parent)
+{
+  MPACK_NODE_DONE(top, parent, tok.type, tok.length);
+}
+
+static int mpack_cnode_done(mpack_cnode_t *top, mpack_cnode_t *parent)
+{
+  MPACK_NODE_DONE(top, parent, type, length);
+}
@@ -8,8 +8,31 @@
 # define MPACK_MAX_OBJECT_DEPTH 32
 #endif
 
+#ifndef MPACK_DPARSER_MIN_CHUNK
+# define MPACK_DPARSER_MIN_CHUNK 16
+#endif
+
 #define MPACK_PARENT_NODE(n) (((n) - 1)->pos == (size_t)-1 ? NULL : (n) - 1)
 
+/* Parent lookup for nodes of a mpack_dparser_t. The first node of a chunk is
+ * preceded by the chunk header, which links to the previous chunk whose last
+ * node is the parent. */
+#define MPACK_DPARENT_NODE(n)                                               \
+  (((n) - 1)->pos == (size_t)-2 ?                                           \
+   (mpack_node_t *)((n) - 1)->data[0].p +                                   \
+   ((mpack_node_t *)((n) - 1)->data[0].p)->tok.length - 1 :                 \
+   MPACK_PARENT_NODE(n))
+
+/* Node records, parent and user data of nodes of a mpack_cparser_t. The
+ * records follow the user data array, so they are located from the limits
+ * instead of a pointer into the struct and a parser can be copied freely. */
+#define MPACK_CPARSER_ITEMS(p) \
+  ((mpack_cnode_t *)((p)->udata + (size_t)(p)->capacity * (p)->slots))
+#define MPACK_CPARENT_NODE(p, n) \
+  ((n) == MPACK_CPARSER_ITEMS(p) ? NULL : (n) - 1)
+#define MPACK_CNODE_DATA(p, n) \
+  ((p)->udata + (size_t)((n) - MPACK_CPARSER_ITEMS(p)) * (p)->slots)
+
 #define MPACK_THROW(parser)           \
   do {                                \
     parser->status = MPACK_EXCEPTION; \
@@ -21,6 +44,11 @@ enum {
   MPACK_NOMEM = MPACK_ERROR + 1
 };
 
+typedef enum {
+  MPACK_EVENT_ENTER = 1,
+  MPACK_EVENT_EXIT
+} mpack_event_type_t;
+
 /* Storing integer in pointers in undefined behavior according to the C
  * standard. Define a union type to accomodate arbitrary user data associated
  * with nodes(and with requests in rpc.h). */
@@ -63,6 +91,74 @@ typedef MPACK_PARSER_STRUCT(0) mpack_one_parser_t;
 typedef MPACK_PARSER_STRUCT(MPACK_MAX_OBJECT_DEPTH) mpack_parser_t;
 typedef void(*mpack_walk_cb)(mpack_parser_t *w, mpack_node_t *n);
 
+/* Event produced by mpack_next_event. `node` is the node that was entered or
+ * exited, `parent` is its parent(NULL for the root) and `depth` is 1 for the
+ * root node. */
+typedef struct mpack_event_s {
+  mpack_event_type_t type;
+  mpack_node_t *node, *parent;
+  mpack_uint32_t depth;
+} mpack_event_t;
+
+/* Allocation function with the semantics of lua_Alloc: resize `ptr` from
+ * `osize` to `nsize` bytes, freeing it when `nsize` is 0. Returns NULL when
+ * the memory can't be allocated. */
+typedef void *(*mpack_alloc_fn)(void *ud, void *ptr, size_t osize,
+    size_t nsize);
+
+/* Parser whose node stack grows on demand instead of being embedded in the
+ * struct. Nodes are stored in chunks that are never moved, so node pointers
+ * remain valid while the node is on the stack. The first item of each chunk
+ * is a header: its tok.length is the number of items in the chunk and
+ * data[0]/data[1] link to the previous/next chunks. Chunks are kept for reuse
+ * until mpack_dparser_destroy is called. */
+typedef struct mpack_dparser_s mpack_dparser_t;
+typedef void(*mpack_dwalk_cb)(mpack_dparser_t *w, mpack_node_t *n);
+
+struct mpack_dparser_s {
+  mpack_data_t data;
+  mpack_uint32_t size, max_depth;
+  int status;
+  int exiting;
+  mpack_tokbuf_t tokbuf;
+  /* top of the stack and header of the chunk that contains it */
+  mpack_node_t *top, *chunk;
+  mpack_node_t *first, *items;
+  mpack_alloc_fn alloc;
+  void *ud;
+};
+
+/* Compact stack record used by mpack_cparser_t. It only has the fields the
+ * parser needs to track progress through containers, so a stack takes a
+ * fraction of the space of mpack_node_t items. */
+typedef struct mpack_cnode_s {
+  mpack_uint32_t length, pos;
+  unsigned type : 8, key_visited : 1;
+} mpack_cnode_t;
+
+/* Parser with a compact stack. The token of a node is only available(in
+ * parser->tok) while it's being entered: the parse enter_cb reads it and the
+ * unparse enter_cb fills it. User data is stored in a separate array with
+ * `s` slots per node, accessed with MPACK_CNODE_DATA. mpack_cparser_t has one
+ * slot, use MPACK_CPARSER_STRUCT(c, s) to declare a parser with different
+ * limits(such as 2 slots, like mpack_node_t) and pass the same values to
+ * mpack_cparser_init. */
+#define MPACK_CPARSER_STRUCT(c, s)    \
+  struct {                            \
+    mpack_data_t data;                \
+    mpack_uint32_t size, capacity;    \
+    mpack_uint32_t slots;             \
+    int status;                       \
+    int exiting;                      \
+    mpack_tokbuf_t tokbuf;            \
+    mpack_token_t tok;                \
+    mpack_data_t udata[(c) * (s)];    \
+    mpack_cnode_t nodes[c];           \
+  }
+
+typedef MPACK_CPARSER_STRUCT(MPACK_MAX_OBJECT_DEPTH, 1) mpack_cparser_t;
+typedef void(*mpack_cwalk_cb)(mpack_cparser_t *w, mpack_cnode_t *n);
+
 MPACK_API void mpack_parser_init(mpack_parser_t *p, mpack_uint32_t c)
   FUNUSED FNONULL;
 
@@ -80,7 +176,108 @@ MPACK_API int mpack_unparse(mpack_parser_t *parser, char **b, size_t *bl,
     mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
   FUNUSED FNONULL_ARG((1,2,3,4,5));
 
+MPACK_API int mpack_next_event(mpack_parser_t *parser, const char **b,
+    size_t *bl, mpack_event_t *ev) FUNUSED FNONULL;
+
+/* Stack operations used by MPACK_PARSE_LOOP: mpack_parser_push returns a
+ * new top node(the parser must not be full) and mpack_parser_pop returns the
+ * next node that was fully processed or NULL if the top node is still
+ * expecting children. */
+MPACK_API mpack_node_t *mpack_parser_push(mpack_parser_t *p) FUNUSED FNONULL;
+MPACK_API mpack_node_t *mpack_parser_pop(mpack_parser_t *p) FUNUSED FNONULL;
+
+/* The parse loop of mpack_parse, expanded in a function with `parser`, `buf`
+ * and `buflen` parameters of mpack_parse's types. It calls enter_fn/exit_fn
+ * directly, so MPACK_DEFINE_PARSE can expand it with callbacks that the
+ * compiler is able to inline. */
+#define MPACK_PARSE_LOOP(enter_fn, exit_fn)                                 \
+  do {                                                                      \
+    int status;                                                             \
+                                                                            \
+    if (parser->status == MPACK_EXCEPTION) return MPACK_EXCEPTION;          \
+                                                                            \
+    while (*buflen) {                                                       \
+      mpack_token_t tok;                                                    \
+      mpack_node_t *n;                                                      \
+      const char *buf_save = *buf;                                          \
+      size_t buflen_save = *buflen;                                         \
+                                                                            \
+      if (parser->size == parser->capacity) return MPACK_NOMEM;             \
+      if ((status = mpack_read(&parser->tokbuf, buf, buflen, &tok))) {      \
+        if (status == MPACK_EOF) continue;                                  \
+        *buf = buf_save;                                                    \
+        *buflen = buflen_save;                                              \
+        return status;                                                      \
+      }                                                                     \
+                                                                            \
+      n = mpack_parser_push(parser);                                        \
+      n->tok = tok;                                                         \
+      enter_fn(parser, n);                                                  \
+      if (parser->status == MPACK_EXCEPTION) return MPACK_EXCEPTION;        \
+                                                                            \
+      while ((n = mpack_parser_pop(parser))) {                              \
+        exit_fn(parser, n);                                                 \
+        if (parser->status == MPACK_EXCEPTION) return MPACK_EXCEPTION;      \
+        if (!parser->size) return MPACK_OK;                                 \
+      }                                                                     \
+    }                                                                       \
+                                                                            \
+    return MPACK_EOF;                                                       \
+  } while (0)
+
+/* Define `static int name(mpack_parser_t *p, const char **b, size_t *bl)`,
+ * which is mpack_parse(p, b, bl, enter_fn, exit_fn) with enter_fn/exit_fn
+ * fixed. They may be functions or function-like macros. When the library is
+ * included with `#define MPACK_API static`, mpack_read and the stack
+ * operations can be inlined too. */
+#define MPACK_DEFINE_PARSE(name, enter_fn, exit_fn)                         \
+  static int name(mpack_parser_t *parser, const char **buf,                 \
+      size_t *buflen) FUNUSED FNONULL;                                      \
+  static int name(mpack_parser_t *parser, const char **buf,                 \
+      size_t *buflen)                                                       \
+  {                                                                         \
+    MPACK_PARSE_LOOP(enter_fn, exit_fn);                                    \
+  }
+
+MPACK_API int mpack_unparse_size(mpack_parser_t *parser, size_t *size,
+    mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,2,3,4));
+
 MPACK_API void mpack_parser_copy(mpack_parser_t *d, mpack_parser_t *s)
   FUNUSED FNONULL;
 
+MPACK_API void mpack_cparser_init(mpack_cparser_t *p, mpack_uint32_t c,
+    mpack_uint32_t s) FUNUSED FNONULL;
+MPACK_API int mpack_cparse_tok(mpack_cparser_t *walker, mpack_token_t tok,
+    mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,3,4));
+MPACK_API int mpack_cunparse_tok(mpack_cparser_t *walker, mpack_token_t *tok,
+    mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,2,3,4));
+MPACK_API int mpack_cparse(mpack_cparser_t *parser, const char **b,
+    size_t *bl, mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,2,3,4,5));
+MPACK_API int mpack_cunparse(mpack_cparser_t *parser, char **b, size_t *bl,
+    mpack_cwalk_cb enter_cb, mpack_cwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,2,3,4,5));
+
+MPACK_API void mpack_dparser_init(mpack_dparser_t *p, mpack_node_t *items,
+    mpack_uint32_t count, mpack_uint32_t max_depth, mpack_alloc_fn alloc,
+    void *ud) FUNUSED FNONULL_ARG((1));
+MPACK_API void mpack_dparser_destroy(mpack_dparser_t *p) FUNUSED FNONULL;
+
+MPACK_API int mpack_dparse_tok(mpack_dparser_t *walker, mpack_token_t tok,
+    mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,3,4));
+MPACK_API int mpack_dunparse_tok(mpack_dparser_t *walker, mpack_token_t *tok,
+    mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,2,3,4));
+
+MPACK_API int mpack_dparse(mpack_dparser_t *parser, const char **b,
+    size_t *bl, mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,2,3,4,5));
+MPACK_API int mpack_dunparse(mpack_dparser_t *parser, char **b, size_t *bl,
+    mpack_dwalk_cb enter_cb, mpack_dwalk_cb exit_cb)
+  FUNUSED FNONULL_ARG((1,2,3,4,5));
+
 #endif  /* MPACK_OBJECT_H */
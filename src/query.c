@@ -0,0 +1,323 @@
+#include <string.h>
+
+#include "query.h"
+
+enum {
+  MPACK_MATCH_VALUE = 0,  /* next value matches the nodes in "cand" */
+  MPACK_MATCH_ITEM,       /* move to the next item of the current container */
+  MPACK_MATCH_KEY,        /* next value is a map key */
+  MPACK_MATCH_KEYDATA,    /* reading the payload of a map key */
+  MPACK_MATCH_PAYLOAD     /* reporting the payload of a matched str/bin/ext */
+};
+
+static int mpack_query_same_edge(const mpack_query_node_t *n,
+    const mpack_path_t *step);
+static mpack_uint32_t mpack_query_new(mpack_query_t *q,
+    mpack_uint32_t parent, const mpack_path_t *step);
+static int mpack_matcher_children(mpack_matcher_t *m, const char *key,
+    mpack_uint32_t keylen, mpack_uint32_t index);
+static void mpack_matcher_reset(mpack_matcher_t *m);
+
+MPACK_API void mpack_query_init(mpack_query_t *query,
+    mpack_query_node_t *nodes, mpack_uint32_t capacity)
+{
+  assert(capacity);
+  query->nodes = nodes;
+  query->capacity = capacity;
+  query->size = 1;
+  nodes[0].key = NULL;
+  nodes[0].keylen = nodes[0].index = 0;
+  nodes[0].child = nodes[0].sibling = 0;
+  nodes[0].id = MPACK_QUERY_NO_ID;
+}
+
+/* Add a pattern to the query. Steps with a NULL key and MPACK_PATH_ANY as
+ * index match any array item or map value. Patterns sharing a prefix share
+ * trie nodes. Returns MPACK_NOMEM when the node array is full and
+ * MPACK_ERROR if a key is longer than MPACK_QUERY_MAX_KEY_LEN. */
+MPACK_API int mpack_query_add(mpack_query_t *query, const mpack_path_t *path,
+    mpack_uint32_t pathlen, mpack_uint32_t id)
+{
+  mpack_uint32_t i, parent = 0, node = 0;
+
+  assert(id != MPACK_QUERY_NO_ID);
+
+  for (i = 0; i < pathlen; i++) {
+    mpack_uint32_t child = query->nodes[node].child;
+
+    if (path[i].key && strlen(path[i].key) > MPACK_QUERY_MAX_KEY_LEN) {
+      return MPACK_ERROR;
+    }
+
+    while (child && !mpack_query_same_edge(query->nodes + child, path + i)) {
+      child = query->nodes[child].sibling;
+    }
+
+    if (!child && !(child = mpack_query_new(query, node, path + i))) {
+      return MPACK_NOMEM;
+    }
+
+    parent = node;
+    node = child;
+  }
+
+  if (query->nodes[node].id != MPACK_QUERY_NO_ID) {
+    /* another pattern ends here, add a node with the same edge that is
+     * matched in parallel */
+    if (!pathlen) return MPACK_ERROR;
+    if (!(node = mpack_query_new(query, parent, path + pathlen - 1))) {
+      return MPACK_NOMEM;
+    }
+  }
+
+  query->nodes[node].id = id;
+  return MPACK_OK;
+}
+
+MPACK_API void mpack_matcher_init(mpack_matcher_t *matcher,
+    const mpack_query_t *query, mpack_query_cb cb)
+{
+  matcher->data.p = NULL;
+  matcher->query = query;
+  matcher->cb = cb;
+  mpack_tokbuf_init(&matcher->tokbuf);
+  mpack_matcher_reset(matcher);
+}
+
+/* Match the next value against the compiled patterns, calling `cb` with the
+ * pattern id and first token of each matching value. The payload of matching
+ * str/bin/ext values is reported as MPACK_TOKEN_CHUNK tokens with the same id.
+ * Subtrees that no pattern can reach are skipped by length. Returns MPACK_OK
+ * once the whole value was consumed(the matcher is then ready for the next
+ * value), MPACK_EOF if more data is required, MPACK_ERROR for invalid input
+ * or MPACK_NOMEM if the value is too deep or too many patterns are active at
+ * once. */
+MPACK_API int mpack_matcher_run(mpack_matcher_t *matcher, const char **buf,
+    size_t *buflen)
+{
+  int status;
+  const mpack_query_node_t *nodes = matcher->query->nodes;
+
+  for (;;) {
+    mpack_token_t tok;
+    mpack_query_level_t *level;
+    mpack_uint32_t i, items;
+
+    if (matcher->skip) {
+      /* mpack_skip also jumps over the payload of the last str/bin/ext read,
+       * counting it as one of the items to skip */
+      if (!*buflen) return MPACK_EOF;
+      if ((status = mpack_skip(&matcher->tokbuf, buf, buflen,
+              &matcher->skip))) {
+        return status;
+      }
+    }
+
+    switch (matcher->state) {
+      case MPACK_MATCH_ITEM:
+        if (!matcher->depth) {
+          mpack_matcher_reset(matcher);
+          return MPACK_OK;
+        }
+        level = matcher->levels + matcher->depth - 1;
+        if (!level->remaining) {
+          matcher->depth--;
+          break;
+        }
+        level->remaining--;
+        if (level->is_map) {
+          matcher->state = MPACK_MATCH_KEY;
+        } else {
+          if ((status = mpack_matcher_children(matcher, NULL, 0,
+                  level->index++))) {
+            return status;
+          }
+          matcher->state = MPACK_MATCH_VALUE;
+        }
+        break;
+
+      case MPACK_MATCH_KEY:
+        if (!*buflen) return MPACK_EOF;
+        if ((status = mpack_read(&matcher->tokbuf, buf, buflen, &tok))) {
+          return status;
+        }
+        if (tok.type == MPACK_TOKEN_STR &&
+            tok.length <= MPACK_QUERY_MAX_KEY_LEN) {
+          matcher->keylen = 0;
+          matcher->state = MPACK_MATCH_KEYDATA;
+          break;
+        }
+        /* only wildcards can match, skip the key */
+        if ((status = mpack_matcher_children(matcher, NULL, 0,
+                MPACK_PATH_ANY))) {
+          return status;
+        }
+        items = tok.type == MPACK_TOKEN_ARRAY ? tok.length :
+                tok.type == MPACK_TOKEN_MAP ? tok.length * 2 : 0;
+        if (tok.type == MPACK_TOKEN_MAP && tok.length > 0x7fffffff) {
+          return MPACK_ERROR;
+        }
+        matcher->skip = items + (matcher->tokbuf.passthrough ? 1 : 0);
+        matcher->state = MPACK_MATCH_VALUE;
+        break;
+
+      case MPACK_MATCH_KEYDATA:
+        while (matcher->tokbuf.passthrough) {
+          if (!*buflen) return MPACK_EOF;
+          mpack_read(&matcher->tokbuf, buf, buflen, &tok);
+          memcpy(matcher->key + matcher->keylen, tok.data.chunk_ptr,
+              tok.length);
+          matcher->keylen += tok.length;
+        }
+        if ((status = mpack_matcher_children(matcher, matcher->key,
+                matcher->keylen, MPACK_PATH_ANY))) {
+          return status;
+        }
+        matcher->state = MPACK_MATCH_VALUE;
+        break;
+
+      case MPACK_MATCH_VALUE:
+        if (!matcher->ccount) {
+          matcher->skip = 1;
+          matcher->state = MPACK_MATCH_ITEM;
+          break;
+        }
+        if (!*buflen) return MPACK_EOF;
+        if ((status = mpack_read(&matcher->tokbuf, buf, buflen, &tok))) {
+          return status;
+        }
+
+        items = 0;
+        for (i = 0; i < matcher->ccount; i++) {
+          mpack_uint32_t id = nodes[matcher->cand[i]].id;
+          if (id != MPACK_QUERY_NO_ID) {
+            matcher->cb(matcher, id, &tok);
+            items++;
+          }
+        }
+
+        if (tok.type > MPACK_TOKEN_MAP) {
+          /* a matched payload is reported, otherwise it is skipped */
+          if (items) {
+            matcher->state = MPACK_MATCH_PAYLOAD;
+          } else {
+            matcher->skip = matcher->tokbuf.passthrough ? 1 : 0;
+            matcher->state = MPACK_MATCH_ITEM;
+          }
+          break;
+        }
+
+        matcher->state = MPACK_MATCH_ITEM;
+        if (tok.type != MPACK_TOKEN_ARRAY && tok.type != MPACK_TOKEN_MAP) {
+          break;
+        }
+
+        if (tok.type == MPACK_TOKEN_MAP && tok.length > 0x7fffffff) {
+          return MPACK_ERROR;
+        }
+        if (matcher->depth == MPACK_QUERY_MAX_DEPTH) return MPACK_NOMEM;
+        level = matcher->levels + matcher->depth;
+        level->count = 0;
+        for (i = 0; i < matcher->ccount; i++) {
+          if (nodes[matcher->cand[i]].child) {
+            level->active[level->count++] = matcher->cand[i];
+          }
+        }
+        if (!level->count) {
+          /* no pattern goes deeper */
+          matcher->skip = tok.type == MPACK_TOKEN_MAP ?
+            tok.length * 2 : tok.length;
+          break;
+        }
+        level->remaining = tok.length;
+        level->index = 0;
+        level->is_map = tok.type == MPACK_TOKEN_MAP;
+        matcher->depth++;
+        break;
+
+      default:
+        assert(matcher->state == MPACK_MATCH_PAYLOAD);
+        while (matcher->tokbuf.passthrough) {
+          if (!*buflen) return MPACK_EOF;
+          mpack_read(&matcher->tokbuf, buf, buflen, &tok);
+          for (i = 0; i < matcher->ccount; i++) {
+            mpack_uint32_t id = nodes[matcher->cand[i]].id;
+            if (id != MPACK_QUERY_NO_ID) matcher->cb(matcher, id, &tok);
+          }
+        }
+        matcher->state = MPACK_MATCH_ITEM;
+        break;
+    }
+  }
+}
+
+static int mpack_query_same_edge(const mpack_query_node_t *node,
+    const mpack_path_t *step)
+{
+  if (!node->key || !step->key) {
+    return !node->key && !step->key && node->index == step->index;
+  }
+  return node->keylen == strlen(step->key) &&
+    !memcmp(node->key, step->key, node->keylen);
+}
+
+/* Add a child to `parent`, returning its index or 0 if the query is full. */
+static mpack_uint32_t mpack_query_new(mpack_query_t *query,
+    mpack_uint32_t parent, const mpack_path_t *step)
+{
+  mpack_uint32_t index;
+  mpack_query_node_t *node;
+
+  if (query->size == query->capacity) return 0;
+  index = query->size++;
+  node = query->nodes + index;
+  node->key = step->key;
+  node->keylen = step->key ? (mpack_uint32_t)strlen(step->key) : 0;
+  node->index = step->index;
+  node->child = 0;
+  node->sibling = query->nodes[parent].child;
+  node->id = MPACK_QUERY_NO_ID;
+  query->nodes[parent].child = index;
+  return index;
+}
+
+/* Compute the nodes matched by the next item of the current container:
+ * children of the active nodes with a wildcard edge or an edge equal to
+ * `key`(map values) or `index`(array items). */
+static int mpack_matcher_children(mpack_matcher_t *matcher, const char *key,
+    mpack_uint32_t keylen, mpack_uint32_t index)
+{
+  const mpack_query_node_t *nodes = matcher->query->nodes;
+  mpack_query_level_t *level = matcher->levels + matcher->depth - 1;
+  mpack_uint32_t i;
+
+  matcher->ccount = 0;
+  for (i = 0; i < level->count; i++) {
+    mpack_uint32_t child = nodes[level->active[i]].child;
+    for (; child; child = nodes[child].sibling) {
+      const mpack_query_node_t *n = nodes + child;
+      int match;
+      if (!n->key) {
+        match = n->index == MPACK_PATH_ANY ||
+          (!level->is_map && n->index == index);
+      } else {
+        match = key && n->keylen == keylen && !memcmp(n->key, key, keylen);
+      }
+      if (!match) continue;
+      if (matcher->ccount == MPACK_QUERY_MAX_ACTIVE) return MPACK_NOMEM;
+      matcher->cand[matcher->ccount++] = child;
+    }
+  }
+
+  return MPACK_OK;
+}
+
+static void mpack_matcher_reset(mpack_matcher_t *matcher)
+{
+  matcher->state = MPACK_MATCH_VALUE;
+  matcher->depth = 0;
+  matcher->skip = 0;
+  matcher->keylen = 0;
+  matcher->ccount = 1;
+  matcher->cand[0] = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef MPACK_QUERY_H
+#define MPACK_QUERY_H
+
+#include "core.h"
+#include "object.h"
+#include "cursor.h"
+
+#ifndef MPACK_QUERY_MAX_DEPTH
+# define MPACK_QUERY_MAX_DEPTH 32
+#endif
+
+/* Maximum number of patterns that can be partially matched at the same
+ * position, which only exceeds 1 when patterns use wildcards */
+#ifndef MPACK_QUERY_MAX_ACTIVE
+# define MPACK_QUERY_MAX_ACTIVE 16
+#endif
+
+#ifndef MPACK_QUERY_MAX_KEY_LEN
+# define MPACK_QUERY_MAX_KEY_LEN 64
+#endif
+
+/* Path step matching any array item or map value */
+#define MPACK_PATH_ANY 0xffffffff
+
+#define MPACK_QUERY_NO_ID 0xffffffff
+
+/* Patterns are compiled into a trie. Node 0 is the root, which represents
+ * the top-level value, and every other node is reached from its parent by a
+ * path step(key/keylen for map keys, index when key is NULL). */
+typedef struct mpack_query_node_s {
+  const char *key;
+  mpack_uint32_t keylen, index;
+  mpack_uint32_t child, sibling;  /* 0 if none */
+  mpack_uint32_t id;              /* Pattern ending here or MPACK_QUERY_NO_ID */
+} mpack_query_node_t;
+
+typedef struct mpack_query_s {
+  mpack_query_node_t *nodes;
+  mpack_uint32_t size, capacity;
+} mpack_query_t;
+
+typedef struct mpack_matcher_s mpack_matcher_t;
+typedef void(*mpack_query_cb)(mpack_matcher_t *m, mpack_uint32_t id,
+    const mpack_token_t *tok);
+
+typedef struct mpack_query_level_s {
+  mpack_uint32_t active[MPACK_QUERY_MAX_ACTIVE];
+  mpack_uint32_t count, remaining, index;
+  int is_map;
+} mpack_query_level_t;
+
+struct mpack_matcher_s {
+  mpack_data_t data;
+  const mpack_query_t *query;
+  mpack_query_cb cb;
+  mpack_tokbuf_t tokbuf;
+  int state;
+  mpack_uint32_t depth, skip, ccount, keylen;
+  mpack_uint32_t cand[MPACK_QUERY_MAX_ACTIVE];
+  char key[MPACK_QUERY_MAX_KEY_LEN];
+  mpack_query_level_t levels[MPACK_QUERY_MAX_DEPTH];
+};
+
+MPACK_API void mpack_query_init(mpack_query_t *q, mpack_query_node_t *n,
+    mpack_uint32_t c) FUNUSED FNONULL;
+MPACK_API int mpack_query_add(mpack_query_t *q, const mpack_path_t *path,
+    mpack_uint32_t pathlen, mpack_uint32_t id) FUNUSED FNONULL;
+MPACK_API void mpack_matcher_init(mpack_matcher_t *m, const mpack_query_t *q,
+    mpack_query_cb cb) FUNUSED FNONULL;
+MPACK_API int mpack_matcher_run(mpack_matcher_t *m, const char **b,
+    size_t *bl) FUNUSED FNONULL;
+
+#endif  /* MPACK_QUERY_H */
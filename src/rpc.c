@@ -49,22 +49,23 @@ MPACK_API int mpack_rpc_receive_tok(mpack_rpc_session_t *session,
 
   if (session->receive.index == 1) {
 
-    if (tok.type != MPACK_TOKEN_UINT || tok.length > 1 || tok.data.value.lo > 2)
+    if (tok.type != MPACK_TOKEN_UINT || tok.length > 1 ||
+        mpack_unpack_uint(tok) > 2)
       /* invalid type */
       return MPACK_RPC_ETYPE;
 
-    if (tok.data.value.lo < 2 && session->receive.toks[0].length != 4)
+    if (mpack_unpack_uint(tok) < 2 && session->receive.toks[0].length != 4)
       /* request or response with array length != 4 */
       return MPACK_RPC_EARRAYL;
 
-    if (tok.data.value.lo == 2 && session->receive.toks[0].length != 3)
+    if (mpack_unpack_uint(tok) == 2 && session->receive.toks[0].length != 3)
       /* notification with array length != 3 */
       return MPACK_RPC_EARRAYL;
 
     session->receive.toks[1] = tok;
     session->receive.index++;
 
-    if (tok.data.value.lo < 2) return MPACK_EOF;
+    if (mpack_unpack_uint(tok) < 2) return MPACK_EOF;
 
     type = MPACK_RPC_NOTIFICATION;
     goto end;
@@ -76,9 +77,9 @@ MPACK_API int mpack_rpc_receive_tok(mpack_rpc_session_t *session,
     /* invalid request/response id */
     return MPACK_RPC_EMSGID;
     
-  msg->id = tok.data.value.lo;
+  msg->id = (mpack_uint32_t)mpack_unpack_uint(tok);
   msg->data.p = NULL;
-  type = (int)session->receive.toks[1].data.value.lo + MPACK_RPC_REQUEST;
+  type = (int)mpack_unpack_uint(session->receive.toks[1]) + MPACK_RPC_REQUEST;
 
   if (type == MPACK_RPC_RESPONSE && !mpack_rpc_pop(session, msg))
     /* response with invalid id */
@@ -99,9 +100,7 @@ MPACK_API int mpack_rpc_request_tok(mpack_rpc_session_t *session,
       msg.id = session->request_id;
       msg.data = data;
       session->send = mpack_rpc_request_hdr();
-      session->send.toks[2].type = MPACK_TOKEN_UINT;
-      session->send.toks[2].data.value.lo = msg.id;
-      session->send.toks[2].data.value.hi = 0;
+      session->send.toks[2] = mpack_pack_uint(msg.id);
       *tok = session->send.toks[0];
       status = mpack_rpc_put(session, msg);
       if (status == -1) return MPACK_NOMEM;
@@ -128,9 +127,7 @@ MPACK_API int mpack_rpc_reply_tok(mpack_rpc_session_t *session,
 {
   if (session->send.index == 0) {
     session->send = mpack_rpc_reply_hdr();
-    session->send.toks[2].type = MPACK_TOKEN_UINT;
-    session->send.toks[2].data.value.lo = id;
-    session->send.toks[2].data.value.hi = 0;
+    session->send.toks[2] = mpack_pack_uint(id);
     *tok = session->send.toks[0];
     session->send.index++;
     return MPACK_EOF;
@@ -259,17 +256,14 @@ static mpack_rpc_header_t mpack_rpc_request_hdr(void)
   hdr.index = 0;
   hdr.toks[0].type = MPACK_TOKEN_ARRAY;
   hdr.toks[0].length = 4;
-  hdr.toks[1].type = MPACK_TOKEN_UINT;
-  hdr.toks[1].data.value.lo = 0;
-  hdr.toks[1].data.value.hi = 0;
+  hdr.toks[1] = mpack_pack_uint(0);
   return hdr;
 }
 
 static mpack_rpc_header_t mpack_rpc_reply_hdr(void)
 {
   mpack_rpc_header_t hdr = mpack_rpc_request_hdr();
-  hdr.toks[1].data.value.lo = 1;
-  hdr.toks[1].data.value.hi = 0;
+  hdr.toks[1] = mpack_pack_uint(1);
   return hdr;
 }
 
@@ -277,8 +271,7 @@ static mpack_rpc_header_t mpack_rpc_notify_hdr(void)
 {
   mpack_rpc_header_t hdr = mpack_rpc_request_hdr();
   hdr.toks[0].length = 3;
-  hdr.toks[1].data.value.lo = 2;
-  hdr.toks[1].data.value.hi = 0;
+  hdr.toks[1] = mpack_pack_uint(2);
   return hdr;
 }
 
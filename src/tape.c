@@ -0,0 +1,84 @@
+#include "tape.h"
+
+MPACK_API void mpack_tape_init(mpack_tape_t *tape,
+    mpack_tape_entry_t *entries, mpack_uint32_t capacity)
+{
+  tape->entries = entries;
+  tape->capacity = capacity;
+  tape->size = 0;
+}
+
+/* Record the next value in *buf into the tape, advancing *buf past it. Offsets
+ * are relative to the initial value of *buf. Returns MPACK_EOF if the value is
+ * truncated, MPACK_ERROR if it is invalid and MPACK_NOMEM if it has more
+ * tokens than the tape capacity or is nested deeper than
+ * MPACK_TAPE_MAX_DEPTH. Nothing is consumed unless MPACK_OK is returned. */
+MPACK_API int mpack_tape_build(mpack_tape_t *tape, const char **buf,
+    size_t *buflen)
+{
+  struct {
+    mpack_uint32_t index, remaining;
+  } stack[MPACK_TAPE_MAX_DEPTH];
+  mpack_uint32_t depth = 0;
+  mpack_tokbuf_t tokbuf;
+  const char *ptr = *buf;
+  size_t ptrlen = *buflen;
+
+  mpack_tokbuf_init(&tokbuf);
+  tape->size = 0;
+
+  for (;;) {
+    int status;
+    mpack_uint32_t index, items = 0;
+    mpack_tape_entry_t *entry;
+
+    if (!ptrlen) return MPACK_EOF;
+    if (tape->size == tape->capacity) return MPACK_NOMEM;
+
+    index = tape->size;
+    entry = tape->entries + index;
+    if ((status = mpack_read(&tokbuf, &ptr, &ptrlen, &entry->tok))) {
+      return status;
+    }
+
+    if (entry->tok.type > MPACK_TOKEN_MAP) {
+      /* jump over the payload instead of reading it as chunks */
+      tokbuf.passthrough = 0;
+      if (ptrlen < entry->tok.length) return MPACK_EOF;
+      entry->offset = (size_t)(ptr - *buf);
+      ptr += entry->tok.length;
+      ptrlen -= entry->tok.length;
+    } else {
+      entry->offset = (size_t)(ptr - *buf);
+      if (entry->tok.type == MPACK_TOKEN_ARRAY) {
+        items = entry->tok.length;
+      } else if (entry->tok.type == MPACK_TOKEN_MAP) {
+        if (entry->tok.length > 0x7fffffff) return MPACK_ERROR;
+        items = entry->tok.length * 2;
+      }
+    }
+
+    tape->size++;
+
+    if (items) {
+      if (depth == MPACK_TAPE_MAX_DEPTH) return MPACK_NOMEM;
+      stack[depth].index = index;
+      stack[depth].remaining = items;
+      depth++;
+      continue;
+    }
+
+    entry->next = tape->size;
+    /* close every container completed by this value */
+    while (depth && !--stack[depth - 1].remaining) {
+      depth--;
+      tape->entries[stack[depth].index].next = tape->size;
+    }
+
+    if (!depth) break;
+  }
+
+  *buf = ptr;
+  *buflen = ptrlen;
+  return MPACK_OK;
+}
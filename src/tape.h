@@ -0,0 +1,32 @@
+#ifndef MPACK_TAPE_H
+#define MPACK_TAPE_H
+
+#include "core.h"
+#include "object.h"
+
+#ifndef MPACK_TAPE_MAX_DEPTH
+# define MPACK_TAPE_MAX_DEPTH 32
+#endif
+
+/* A tape is a flat array with one entry per token of a fully buffered value,
+ * in the order they appear in the buffer. The first child of an array/map at
+ * index "i" is at "i + 1", and "next" is the index of the entry that follows
+ * the whole subtree, so siblings can be skipped without decoding anything. */
+typedef struct mpack_tape_entry_s {
+  mpack_token_t tok;    /* str/bin/ext payloads are not split into chunks */
+  size_t offset;        /* Offset of the bytes following the token header,
+                           which is the payload for str/bin/ext */
+  mpack_uint32_t next;  /* Index of the entry after this subtree */
+} mpack_tape_entry_t;
+
+typedef struct mpack_tape_s {
+  mpack_tape_entry_t *entries;
+  mpack_uint32_t size, capacity;
+} mpack_tape_t;
+
+MPACK_API void mpack_tape_init(mpack_tape_t *t, mpack_tape_entry_t *e,
+    mpack_uint32_t c) FUNUSED FNONULL;
+MPACK_API int mpack_tape_build(mpack_tape_t *t, const char **b, size_t *bl)
+  FUNUSED FNONULL;
+
+#endif  /* MPACK_TAPE_H */
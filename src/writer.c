@@ -0,0 +1,821 @@
+#include <string.h>
+
+#include "writer.h"
+#include "encode.h"
+
+static int mpack_w_fast(mpack_writer_t *w, size_t len);
+static int mpack_w_spill(mpack_writer_t *w, mpack_token_t tok);
+static int mpack_w_blob(mpack_writer_t *w, mpack_token_t tok, const char *s);
+static int mpack_w_header(mpack_writer_t *w, mpack_token_t tok);
+static int mpack_w_open(mpack_writer_t *w, mpack_uint32_t bound,
+    mpack_uint32_t code16);
+static void mpack_wcontainer(char **p, size_t *pl, mpack_token_type_t t,
+    mpack_uint32_t l);
+static size_t mpack_w_run(mpack_writer_t *w, size_t n);
+static void mpack_wuint(char **p, size_t *pl, mpack_uintmax_t v);
+static void mpack_wsint(char **p, size_t *pl, mpack_sintmax_t v);
+static void mpack_wdouble(char **p, size_t *pl, double v);
+static void mpack_wnumber(char **p, size_t *pl, double v);
+static void mpack_w_uints(char **p, size_t *pl, const mpack_uintmax_t *v,
+    size_t n);
+static void mpack_w_sints(char **p, size_t *pl, const mpack_sintmax_t *v,
+    size_t n);
+static void mpack_w_floats(char **p, size_t *pl, const float *v, size_t n);
+static void mpack_w_doubles(char **p, size_t *pl, const double *v,
+    size_t n);
+static void mpack_w_numbers(char **p, size_t *pl, const double *v,
+    size_t n);
+#ifdef MPACK_SSE2
+static int mpack_w_fixints16(char *p, const void *v, int sint);
+# ifdef MPACK_PACK_FLOAT_FAST
+static void mpack_w_doubles2(char **p, size_t *pl, const double *v);
+#  ifdef MPACK_SSSE3
+static int mpack_w_floats4(char *p, const float *v);
+#  endif
+# endif
+#endif
+static int mpack_iowrite_copy(mpack_iowriter_t *w, const char *data,
+    size_t len);
+static void mpack_w_advance(mpack_writer_t *w, char *p);
+
+MPACK_API void mpack_writer_init(mpack_writer_t *w, char *buf, size_t buflen)
+{
+  w->buf = buf;
+  w->buflen = buflen;
+  w->start = buf;
+  w->depth = 0;
+  w->pos = 0;
+  w->payload = 0;
+  mpack_tokbuf_init(&w->tokbuf);
+}
+
+MPACK_API int mpack_w_nil(mpack_writer_t *w)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (!mpack_w_fast(w, 1)) return mpack_w_spill(w, mpack_pack_nil());
+  mpack_w1(&p, &plen, 0xc0);
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_w_boolean(mpack_writer_t *w, unsigned v)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (!mpack_w_fast(w, 1)) return mpack_w_spill(w, mpack_pack_boolean(v));
+  mpack_w1(&p, &plen, v ? 0xc3 : 0xc2);
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_w_uint(mpack_writer_t *w, mpack_uintmax_t v)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (!mpack_w_fast(w, MPACK_MAX_TOKEN_LEN)) {
+    return mpack_w_spill(w, mpack_pack_uint(v));
+  }
+  mpack_wuint(&p, &plen, v);
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_w_sint(mpack_writer_t *w, mpack_sintmax_t v)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (!mpack_w_fast(w, MPACK_MAX_TOKEN_LEN)) {
+    return mpack_w_spill(w, mpack_pack_sint(v));
+  }
+  mpack_wsint(&p, &plen, v);
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+/* Write the items of an integer array(the header is written separately with
+ * mpack_w_array), storing the number of items fully written in *written.
+ * Runs of buflen / MPACK_MAX_TOKEN_LEN items are encoded with no per-item
+ * capacity checks; the output is the same as calling mpack_w_uint for each
+ * item. On MPACK_EOF the item at v[*written] may have been partially written
+ * and must be passed again(first) after a new buffer is provided. */
+MPACK_API int mpack_w_uint_array(mpack_writer_t *w, const mpack_uintmax_t *v,
+    size_t n, size_t *written)
+{
+  int status = MPACK_OK;
+  size_t i = 0;
+
+  while (i < n) {
+    size_t end = i + mpack_w_run(w, n - i);
+    if (end > i) {
+      char *p = w->buf;
+      size_t plen = w->buflen;
+      mpack_w_uints(&p, &plen, v + i, end - i);
+      i = end;
+      mpack_w_advance(w, p);
+    } else {
+      if ((status = mpack_w_uint(w, v[i]))) break;
+      i++;
+    }
+  }
+
+  *written = i;
+  return status;
+}
+
+MPACK_API int mpack_w_sint_array(mpack_writer_t *w, const mpack_sintmax_t *v,
+    size_t n, size_t *written)
+{
+  int status = MPACK_OK;
+  size_t i = 0;
+
+  while (i < n) {
+    size_t end = i + mpack_w_run(w, n - i);
+    if (end > i) {
+      char *p = w->buf;
+      size_t plen = w->buflen;
+      mpack_w_sints(&p, &plen, v + i, end - i);
+      i = end;
+      mpack_w_advance(w, p);
+    } else {
+      if ((status = mpack_w_sint(w, v[i]))) break;
+      i++;
+    }
+  }
+
+  *written = i;
+  return status;
+}
+
+/* Float arrays follow the same protocol, items are written as
+ * mpack_w_double would. */
+MPACK_API int mpack_w_float_array(mpack_writer_t *w, const float *v,
+    size_t n, size_t *written)
+{
+  int status = MPACK_OK;
+  size_t i = 0;
+
+  while (i < n) {
+    size_t end = i + mpack_w_run(w, n - i);
+    if (end > i) {
+      char *p = w->buf;
+      size_t plen = w->buflen;
+      mpack_w_floats(&p, &plen, v + i, end - i);
+      i = end;
+      mpack_w_advance(w, p);
+    } else {
+      if ((status = mpack_w_double(w, (double)v[i]))) break;
+      i++;
+    }
+  }
+
+  *written = i;
+  return status;
+}
+
+MPACK_API int mpack_w_double_array(mpack_writer_t *w, const double *v,
+    size_t n, size_t *written)
+{
+  int status = MPACK_OK;
+  size_t i = 0;
+
+  while (i < n) {
+    size_t end = i + mpack_w_run(w, n - i);
+    if (end > i) {
+      char *p = w->buf;
+      size_t plen = w->buflen;
+      mpack_w_doubles(&p, &plen, v + i, end - i);
+      i = end;
+      mpack_w_advance(w, p);
+    } else {
+      if ((status = mpack_w_double(w, v[i]))) break;
+      i++;
+    }
+  }
+
+  *written = i;
+  return status;
+}
+
+/* Numbers are classified with mpack_pack_number, so integral doubles are
+ * written as the smallest integer that holds them. */
+MPACK_API int mpack_w_number_array(mpack_writer_t *w, const double *v,
+    size_t n, size_t *written)
+{
+  int status = MPACK_OK;
+  size_t i = 0;
+
+  while (i < n) {
+    size_t end = i + mpack_w_run(w, n - i);
+    if (end > i) {
+      char *p = w->buf;
+      size_t plen = w->buflen;
+      mpack_w_numbers(&p, &plen, v + i, end - i);
+      i = end;
+      mpack_w_advance(w, p);
+    } else {
+      if ((status = mpack_w_number(w, v[i]))) break;
+      i++;
+    }
+  }
+
+  *written = i;
+  return status;
+}
+
+MPACK_API int mpack_w_number(mpack_writer_t *w, double v)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (!mpack_w_fast(w, MPACK_MAX_TOKEN_LEN)) {
+    return mpack_w_spill(w, mpack_pack_number(v));
+  }
+  mpack_wnumber(&p, &plen, v);
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_w_double(mpack_writer_t *w, double v)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (!mpack_w_fast(w, MPACK_MAX_TOKEN_LEN)) {
+    return mpack_w_spill(w, mpack_pack_float(v));
+  }
+  mpack_wdouble(&p, &plen, v);
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_w_str(mpack_writer_t *w, const char *s, mpack_uint32_t l)
+{
+  return mpack_w_blob(w, mpack_pack_str(l), s);
+}
+
+MPACK_API int mpack_w_bin(mpack_writer_t *w, const char *s, mpack_uint32_t l)
+{
+  return mpack_w_blob(w, mpack_pack_bin(l), s);
+}
+
+MPACK_API int mpack_w_array(mpack_writer_t *w, mpack_uint32_t l)
+{
+  return mpack_w_header(w, mpack_pack_array(l));
+}
+
+MPACK_API int mpack_w_map(mpack_writer_t *w, mpack_uint32_t l)
+{
+  return mpack_w_header(w, mpack_pack_map(l));
+}
+
+/* Open an array/map whose length is only known when it is closed. A 3-byte
+ * header is reserved when `bound`(the maximum length) is below 0x10000,
+ * otherwise a 5-byte one. Returns MPACK_EOF without writing anything when the
+ * header doesn't fit in the buffer. */
+MPACK_API int mpack_w_array_open(mpack_writer_t *w, mpack_uint32_t bound)
+{
+  return mpack_w_open(w, bound, 0xdc);
+}
+
+MPACK_API int mpack_w_map_open(mpack_writer_t *w, mpack_uint32_t bound)
+{
+  return mpack_w_open(w, bound, 0xde);
+}
+
+/* Close the innermost open container, storing its length(number of items
+ * for arrays, pairs for maps) in the reserved header. */
+MPACK_API int mpack_w_close(mpack_writer_t *w, mpack_uint32_t count)
+{
+  char *header;
+  size_t headerlen = 5, offset;
+  mpack_uint32_t code;
+  assert(w->depth);
+  offset = w->pos - w->open[w->depth - 1];
+  /* the header was already flushed with a previous buffer */
+  if (offset > (size_t)(w->buf - w->start)) return MPACK_ERROR;
+  header = w->buf - offset;
+  code = (unsigned char)*header;
+  if (!(code & 1) && count >= 0x10000) return MPACK_ERROR;
+
+  w->depth--;
+  if (code & 1) {
+    mpack_wh4(&header, &headerlen, code, count);
+  } else {
+    mpack_wh2(&header, &headerlen, code, count);
+  }
+
+  return MPACK_OK;
+}
+
+/* Rewrite every array/map header in a buffer of complete values with the
+ * shortest encoding, shrinking the headers reserved for open containers.
+ * The buffer is compacted in place and *buflen updated. If the buffer has an
+ * invalid or truncated value, the compacted prefix is kept followed by the
+ * rest of the input, and MPACK_ERROR/MPACK_EOF is returned. */
+MPACK_API int mpack_w_compact(char *buf, size_t *buflen)
+{
+  mpack_tokbuf_t tokbuf;
+  const char *src = buf;
+  size_t srclen = *buflen;
+  char *dst = buf;
+
+  mpack_tokbuf_init(&tokbuf);
+
+  while (srclen) {
+    int status;
+    mpack_token_t tok;
+    const char *start = src;
+    size_t startlen = srclen;
+
+    if ((status = mpack_read(&tokbuf, &src, &srclen, &tok))) {
+      memmove(dst, start, startlen);
+      *buflen = (size_t)(dst - buf) + startlen;
+      return status;
+    }
+
+    if (tok.type == MPACK_TOKEN_ARRAY || tok.type == MPACK_TOKEN_MAP) {
+      size_t dstlen = MPACK_MAX_TOKEN_LEN;
+      mpack_wcontainer(&dst, &dstlen, tok.type, tok.length);
+    } else {
+      memmove(dst, start, (size_t)(src - start));
+      dst += src - start;
+    }
+  }
+
+  *buflen = (size_t)(dst - buf);
+  return MPACK_OK;
+}
+
+MPACK_API void mpack_iowriter_init(mpack_iowriter_t *w, mpack_iovec_t *iov,
+    size_t iovcap, char *buf, size_t buflen, size_t threshold)
+{
+  w->iov = iov;
+  w->iovcap = iovcap;
+  w->buf = buf;
+  w->buflen = buflen;
+  w->threshold = threshold;
+  mpack_iowriter_reset(w);
+}
+
+/* Start a new list after the vectors were written out. */
+MPACK_API void mpack_iowriter_reset(mpack_iowriter_t *w)
+{
+  w->iovcnt = 0;
+  w->bufpos = 0;
+}
+
+/* Append a token to the list. Returns MPACK_EOF without writing anything when
+ * there are no vectors or buffer space left, in which case the caller should
+ * flush the vectors, call mpack_iowriter_reset and repeat the call. */
+MPACK_API int mpack_iowrite(mpack_iowriter_t *w, const mpack_token_t *tok)
+{
+  int status;
+  char header[MPACK_MAX_TOKEN_LEN];
+  char *ptr = header;
+  size_t ptrlen = sizeof(header);
+  mpack_tokbuf_t tokbuf;
+
+  if (tok->type == MPACK_TOKEN_CHUNK) {
+    if (!tok->length) return MPACK_OK;
+    if (tok->length < w->threshold) {
+      return mpack_iowrite_copy(w, tok->data.chunk_ptr, tok->length);
+    }
+    if (w->iovcnt == w->iovcap) return MPACK_EOF;
+    w->iov[w->iovcnt].iov_base = (void *)tok->data.chunk_ptr;
+    w->iov[w->iovcnt].iov_len = tok->length;
+    w->iovcnt++;
+    return MPACK_OK;
+  }
+
+  mpack_tokbuf_init(&tokbuf);
+  if ((status = mpack_write(&tokbuf, &ptr, &ptrlen, tok))) return status;
+  return mpack_iowrite_copy(w, header, sizeof(header) - ptrlen);
+}
+
+MPACK_API void mpack_sbuf_init(mpack_sbuf_t *s, mpack_alloc_fn alloc,
+    void *ud)
+{
+  s->data = NULL;
+  s->size = s->capacity = 0;
+  s->alloc = alloc;
+  s->ud = ud;
+}
+
+MPACK_API void mpack_sbuf_destroy(mpack_sbuf_t *s)
+{
+  if (s->data) s->alloc(s->ud, s->data, s->capacity, 0);
+  s->data = NULL;
+  s->size = s->capacity = 0;
+}
+
+/* Make room for at least `n` more bytes, doubling the capacity as needed.
+ * Returns MPACK_NOMEM if the allocation fails, leaving the buffer intact. */
+MPACK_API int mpack_sbuf_reserve(mpack_sbuf_t *s, size_t n)
+{
+  char *data;
+  size_t capacity = s->capacity ? s->capacity : MPACK_SBUF_MIN_CAPACITY;
+
+  if (n <= s->capacity - s->size) return MPACK_OK;
+
+  while (n > capacity - s->size) {
+    if (capacity > (size_t)-1 / 2) return MPACK_NOMEM;
+    capacity *= 2;
+  }
+
+  if (!(data = s->alloc(s->ud, s->data, s->capacity, capacity))) {
+    return MPACK_NOMEM;
+  }
+
+  s->data = data;
+  s->capacity = capacity;
+  return MPACK_OK;
+}
+
+MPACK_API int mpack_write_sbuf(mpack_sbuf_t *s, const mpack_token_t *tok)
+{
+  int status;
+  char *ptr;
+  size_t ptrlen;
+  mpack_tokbuf_t tokbuf;
+
+  if (tok->type == MPACK_TOKEN_CHUNK) {
+    if ((status = mpack_sbuf_reserve(s, tok->length))) return status;
+    if (tok->length) {
+      memcpy(s->data + s->size, tok->data.chunk_ptr, tok->length);
+      s->size += tok->length;
+    }
+    return MPACK_OK;
+  }
+
+  if ((status = mpack_sbuf_reserve(s, MPACK_MAX_TOKEN_LEN))) return status;
+  ptr = s->data + s->size;
+  ptrlen = s->capacity - s->size;
+  mpack_tokbuf_init(&tokbuf);
+  if ((status = mpack_write(&tokbuf, &ptr, &ptrlen, tok))) return status;
+  s->size = s->capacity - ptrlen;
+  return MPACK_OK;
+}
+
+/* Unparse into `s`, growing it until the whole object is written. Returns
+ * MPACK_OK, or the status of mpack_unparse/mpack_sbuf_reserve on failure. */
+MPACK_API int mpack_unparse_sbuf(mpack_sbuf_t *s, mpack_parser_t *parser,
+    mpack_walk_cb enter_cb, mpack_walk_cb exit_cb)
+{
+  int status;
+
+  do {
+    char *ptr;
+    size_t ptrlen;
+    if ((status = mpack_sbuf_reserve(s, 1))) return status;
+    ptr = s->data + s->size;
+    ptrlen = s->capacity - s->size;
+    status = mpack_unparse(parser, &ptr, &ptrlen, enter_cb, exit_cb);
+    s->size = s->capacity - ptrlen;
+  } while (status == MPACK_EOF);
+
+  return status;
+}
+
+/* Nothing is pending in tokbuf and `len` bytes are available. */
+static int mpack_w_fast(mpack_writer_t *w, size_t len)
+{
+  return !w->tokbuf.plen && !w->payload && w->buflen >= len;
+}
+
+static int mpack_w_spill(mpack_writer_t *w, mpack_token_t tok)
+{
+  size_t buflen = w->buflen;
+  int status;
+  if (!buflen) return MPACK_EOF;
+  status = mpack_write(&w->tokbuf, &w->buf, &w->buflen, &tok);
+  w->pos += buflen - w->buflen;
+  return status;
+}
+
+/* Write a str/bin header followed by its payload. On the slow path `payload`
+ * is set once the header has been written, so a repeated call only resumes
+ * the payload. */
+static int mpack_w_blob(mpack_writer_t *w, mpack_token_t tok, const char *s)
+{
+  int status;
+  mpack_uint32_t l = tok.length;
+
+  if (mpack_w_fast(w, 5) && l <= w->buflen - 5) {
+    char *p = w->buf;
+    size_t plen = w->buflen;
+    if (tok.type == MPACK_TOKEN_STR) mpack_wstr(&p, &plen, l);
+    else mpack_wbin(&p, &plen, l);
+    memcpy(p, s, l);
+    mpack_w_advance(w, p + l);
+    return MPACK_OK;
+  }
+
+  if (!w->payload) {
+    if ((status = mpack_w_spill(w, tok))) return status;
+    if (!l) return MPACK_OK;
+    w->payload = 1;
+  }
+
+  if ((status = mpack_w_spill(w, mpack_pack_chunk(s, l)))) return status;
+  w->payload = 0;
+  return MPACK_OK;
+}
+
+static int mpack_w_header(mpack_writer_t *w, mpack_token_t tok)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (!mpack_w_fast(w, 5)) return mpack_w_spill(w, tok);
+  mpack_wcontainer(&p, &plen, tok.type, tok.length);
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+/* `code16` is the 16-bit array/map format and `code16 + 1` the 32-bit one. */
+static int mpack_w_open(mpack_writer_t *w, mpack_uint32_t bound,
+    mpack_uint32_t code16)
+{
+  char *p = w->buf;
+  size_t plen = w->buflen;
+
+  if (w->depth == MPACK_WRITER_MAX_DEPTH) return MPACK_NOMEM;
+  if (!mpack_w_fast(w, bound < 0x10000 ? 3 : 5)) return MPACK_EOF;
+
+  w->open[w->depth++] = w->pos;
+  if (bound < 0x10000) {
+    mpack_wh2(&p, &plen, code16, 0);
+  } else {
+    mpack_wh4(&p, &plen, code16 + 1, 0);
+  }
+
+  mpack_w_advance(w, p);
+  return MPACK_OK;
+}
+
+static void mpack_wcontainer(char **p, size_t *pl, mpack_token_type_t t,
+    mpack_uint32_t l)
+{
+  if (t == MPACK_TOKEN_ARRAY) mpack_warray(p, pl, l);
+  else mpack_wmap(p, pl, l);
+}
+
+/* Number of numbers(up to n) that can be written with no capacity checks. */
+static size_t mpack_w_run(mpack_writer_t *w, size_t n)
+{
+  size_t run;
+  if (!mpack_w_fast(w, MPACK_MAX_TOKEN_LEN)) return 0;
+  run = w->buflen / MPACK_MAX_TOKEN_LEN;
+  return run < n ? run : n;
+}
+
+/* Integer tokens from mpack_pack_uint/mpack_pack_sint */
+/* Same value layout as mpack_pack_uint/mpack_pack_sint, built here so the
+ * integer writers don't call into conv.c for every item. */
+static void mpack_wuint(char **p, size_t *pl, mpack_uintmax_t v)
+{
+  mpack_value_t val;
+#ifdef MPACK_NATIVE64
+  val.u = v;
+#else
+  val.lo = v & 0xffffffff;
+  val.hi = (mpack_uint32_t)((v >> 31) >> 1);
+#endif
+  mpack_wpint(p, pl, val);
+}
+
+static void mpack_wsint(char **p, size_t *pl, mpack_sintmax_t v)
+{
+  mpack_uintmax_t u = (mpack_uintmax_t)v;
+  mpack_value_t val;
+
+  if (v >= 0) {
+    mpack_wuint(p, pl, u);
+    return;
+  }
+#ifdef MPACK_NATIVE64
+  val.u = u;
+#else
+  val.lo = u & 0xffffffff;
+  val.hi = (mpack_uint32_t)((u >> 31) >> 1);
+#endif
+  mpack_wnint(p, pl, val);
+}
+
+static void mpack_wdouble(char **p, size_t *pl, double v)
+{
+  mpack_token_t tok = mpack_pack_float(v);
+  mpack_wfloat(p, pl, &tok);
+}
+
+/* mpack_pack_number only makes SINT tokens of negative values. */
+static void mpack_wnumber(char **p, size_t *pl, double v)
+{
+  mpack_token_t tok = mpack_pack_number(v);
+  if (tok.type == MPACK_TOKEN_UINT) mpack_wpint(p, pl, tok.data.value);
+  else if (tok.type == MPACK_TOKEN_SINT) mpack_wnint(p, pl, tok.data.value);
+  else mpack_wfloat(p, pl, &tok);
+}
+
+/* Scalar loops for the runs of the array writers. Where vector paths are
+ * available they take blocks of items that share one encoding and leave the
+ * rest to the same per-item encoders. Integer blocks are only tried when
+ * their first item is a fixint, so wide values don't pay for the check. */
+static void mpack_w_uints(char **p, size_t *pl, const mpack_uintmax_t *v,
+    size_t n)
+{
+  size_t i = 0;
+#ifdef MPACK_SSE2
+  for (; n - i >= 16; i += 16) {
+    size_t j;
+    if (v[i] < 0x80 && mpack_w_fixints16(*p, v + i, 0)) {
+      *p += 16;
+      *pl -= 16;
+    } else {
+      for (j = i; j < i + 16; j++) mpack_wuint(p, pl, v[j]);
+    }
+  }
+#endif
+  for (; i < n; i++) mpack_wuint(p, pl, v[i]);
+}
+
+static void mpack_w_sints(char **p, size_t *pl, const mpack_sintmax_t *v,
+    size_t n)
+{
+  size_t i = 0;
+#ifdef MPACK_SSE2
+  for (; n - i >= 16; i += 16) {
+    size_t j;
+    if ((mpack_uintmax_t)v[i] + 0x20 < 0xa0 &&
+        mpack_w_fixints16(*p, v + i, 1)) {
+      *p += 16;
+      *pl -= 16;
+    } else {
+      for (j = i; j < i + 16; j++) mpack_wsint(p, pl, v[j]);
+    }
+  }
+#endif
+  for (; i < n; i++) mpack_wsint(p, pl, v[i]);
+}
+
+static void mpack_w_floats(char **p, size_t *pl, const float *v, size_t n)
+{
+  size_t i = 0;
+#if defined(MPACK_SSSE3) && defined(MPACK_PACK_FLOAT_FAST)
+  for (; n - i >= 4; i += 4) {
+    size_t j;
+    if (mpack_w_floats4(*p, v + i)) {
+      *p += 20;
+      *pl -= 20;
+    } else {
+      for (j = i; j < i + 4; j++) mpack_wdouble(p, pl, (double)v[j]);
+    }
+  }
+#endif
+  for (; i < n; i++) mpack_wdouble(p, pl, (double)v[i]);
+}
+
+static void mpack_w_doubles(char **p, size_t *pl, const double *v,
+    size_t n)
+{
+  size_t i = 0;
+#if defined(MPACK_SSE2) && defined(MPACK_PACK_FLOAT_FAST)
+  for (; n - i >= 2; i += 2) mpack_w_doubles2(p, pl, v + i);
+#endif
+  for (; i < n; i++) mpack_wdouble(p, pl, v[i]);
+}
+
+static void mpack_w_numbers(char **p, size_t *pl, const double *v,
+    size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++) mpack_wnumber(p, pl, v[i]);
+}
+
+#ifdef MPACK_SSE2
+/* Write 16 integers as 16 fixint bytes if they all are in the fixint range:
+ * 0..0x7f, or -0x20..0x7f for signed items. Items are biased by 0x20 when
+ * signed, so the check is that each one fits in its low byte and that byte
+ * is at most 0x7f plus the bias. */
+static int mpack_w_fixints16(char *p, const void *v, int sint)
+{
+  const __m128i *in = (const __m128i *)v;
+  __m128i bias = _mm_set1_epi64x(sint ? 0x20 : 0);
+  __m128i x[8], any = _mm_setzero_si128(), lo, hi, bytes;
+  int k;
+
+  for (k = 0; k < 8; k++) {
+    x[k] = _mm_add_epi64(_mm_loadu_si128(in + k), bias);
+    any = _mm_or_si128(any, x[k]);
+  }
+  any = _mm_andnot_si128(_mm_set1_epi64x(0xff), any);
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xffff) {
+    return 0;
+  }
+
+  /* every item is now a 0..0xff value in its low 32-bit half, so signed
+   * saturating packs narrow them without changing them */
+  lo = _mm_packs_epi32(_mm_packs_epi32(x[0], x[1]),
+                       _mm_packs_epi32(x[2], x[3]));
+  hi = _mm_packs_epi32(_mm_packs_epi32(x[4], x[5]),
+                       _mm_packs_epi32(x[6], x[7]));
+  bytes = _mm_packus_epi16(lo, hi);
+  lo = _mm_set1_epi8((char)(sint ? 0x9f : 0x7f));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(bytes, lo), bytes))
+      != 0xffff) {
+    return 0;
+  }
+
+  _mm_storeu_si128((__m128i *)p,
+      _mm_sub_epi8(bytes, _mm_set1_epi8((char)(sint ? 0x20 : 0))));
+  return 1;
+}
+
+# ifdef MPACK_PACK_FLOAT_FAST
+/* Write two doubles, classifying both at once as mpack_pack_float_fast would:
+ * a double is written as float 32 when converting it to float and back gives
+ * the same value. */
+static void mpack_w_doubles2(char **p, size_t *pl, const double *v)
+{
+  __m128d d = _mm_loadu_pd(v);
+  __m128 f = _mm_cvtpd_ps(d);
+  int fits = _mm_movemask_pd(_mm_cmpeq_pd(_mm_cvtps_pd(f), d));
+  float s[4];
+  int k;
+
+  _mm_storeu_ps(s, f);
+  for (k = 0; k < 2; k++) {
+    if (fits & (1 << k)) {
+      mpack_uint32_t m;
+      memcpy(&m, s + k, sizeof(m));
+      mpack_wh4(p, pl, 0xca, m);
+    } else {
+      unsigned long long m;
+      memcpy(&m, v + k, sizeof(m));
+      mpack_wh8(p, pl, 0xcb, (mpack_uint32_t)(m >> 32), (mpack_uint32_t)m);
+    }
+  }
+}
+
+#  ifdef MPACK_SSSE3
+/* Write 4 floats as 0xca items with one byte shuffle, unless one of them is
+ * NaN: the scalar path converts through double, which quiets signaling NaNs,
+ * so those are left to it. */
+static int mpack_w_floats4(char *p, const float *v)
+{
+  __m128 f = _mm_loadu_ps(v);
+  __m128i x = _mm_castps_si128(f);
+  /* bytes 0-15 are: lead, f0, lead, f1, lead, f2, lead; bytes 16-19 are f3 */
+  __m128i swap = _mm_setr_epi8(-1, 3, 2, 1, 0, -1, 7, 6, 5, 4, -1, 11, 10, 9,
+                               8, -1);
+  __m128i lead = _mm_setr_epi8((char)0xca, 0, 0, 0, 0, (char)0xca, 0, 0, 0,
+                               0, (char)0xca, 0, 0, 0, 0, (char)0xca);
+
+  if (_mm_movemask_ps(_mm_cmpunord_ps(f, f))) return 0;
+  _mm_storeu_si128((__m128i *)p,
+      _mm_or_si128(_mm_shuffle_epi8(x, swap), lead));
+  mpack_store32(p + 16,
+      (mpack_uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x, 12)));
+  return 1;
+}
+#  endif
+# endif
+#endif
+
+/* Copy bytes to the owned buffer, growing the last vector when it already
+ * ends there. */
+static int mpack_iowrite_copy(mpack_iowriter_t *w, const char *data,
+    size_t len)
+{
+  char *p = w->buf + w->bufpos;
+  mpack_iovec_t *last = w->iovcnt ? w->iov + w->iovcnt - 1 : NULL;
+  int extend = last && (char *)last->iov_base + last->iov_len == p;
+
+  if (len > w->buflen - w->bufpos || (!extend && w->iovcnt == w->iovcap)) {
+    return MPACK_EOF;
+  }
+
+  memcpy(p, data, len);
+  w->bufpos += len;
+  if (extend) {
+    last->iov_len += len;
+  } else {
+    w->iov[w->iovcnt].iov_base = p;
+    w->iov[w->iovcnt].iov_len = len;
+    w->iovcnt++;
+  }
+  return MPACK_OK;
+}
+
+static void mpack_w_advance(mpack_writer_t *w, char *p)
+{
+  size_t len = (size_t)(p - w->buf);
+  w->buflen -= len;
+  w->pos += len;
+  w->buf = p;
+}
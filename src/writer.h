@@ -0,0 +1,117 @@
+#ifndef MPACK_WRITER_H
+#define MPACK_WRITER_H
+
+#include "core.h"
+#include "conv.h"
+#include "object.h"
+
+#ifndef MPACK_WRITER_MAX_DEPTH
+# define MPACK_WRITER_MAX_DEPTH 32
+#endif
+
+#ifndef MPACK_SBUF_MIN_CAPACITY
+# define MPACK_SBUF_MIN_CAPACITY 64
+#endif
+
+/* Typed writer that encodes values straight into the output buffer. Each call
+ * checks the available space once; when the value doesn't fit it is written
+ * through mpack_write, and the rest is kept in `tokbuf` until a new buffer is
+ * provided. `buf` and `buflen` are advanced as values are written and can be
+ * reassigned when the writer returns MPACK_EOF, in which case the same call
+ * must be repeated to flush the remaining bytes.
+ *
+ * Containers opened with mpack_w_array_open/mpack_w_map_open reserve a
+ * header that is backpatched by mpack_w_close. Headers are remembered by
+ * their offset in the output, so the buffer may be moved or grown while a
+ * container is open(eg with mpack_sbuf_reserve) as long as everything
+ * written since the header directly precedes the new `buf`. `start` marks the
+ * beginning of the bytes still available to backpatch: when `buf` is
+ * reassigned it must be set too, to the new buffer or to where the kept bytes
+ * were moved. mpack_w_close returns MPACK_ERROR if the header is before it. */
+typedef struct mpack_writer_s {
+  char *buf;
+  size_t buflen;
+  char *start;
+  mpack_tokbuf_t tokbuf;
+  mpack_uint32_t payload;  /* set while a str/bin payload is pending */
+  mpack_uint32_t depth;
+  size_t pos;  /* bytes written since mpack_writer_init */
+  size_t open[MPACK_WRITER_MAX_DEPTH];  /* offsets of the reserved headers */
+} mpack_writer_t;
+
+/* Same layout as the POSIX struct iovec, so an array of these can be passed
+ * to writev/sendmsg. */
+typedef struct mpack_iovec_s {
+  void *iov_base;
+  size_t iov_len;
+} mpack_iovec_t;
+
+/* Token writer producing a scatter-gather list. Headers and chunks shorter
+ * than `threshold` are copied to `buf`, larger chunks are referenced in place
+ * and must stay valid until the vectors are written out. */
+typedef struct mpack_iowriter_s {
+  mpack_iovec_t *iov;
+  size_t iovcnt, iovcap;
+  char *buf;
+  size_t bufpos, buflen;
+  size_t threshold;
+} mpack_iowriter_t;
+
+/* Growable output buffer. `size` bytes of `data` have been written. */
+typedef struct mpack_sbuf_s {
+  char *data;
+  size_t size, capacity;
+  mpack_alloc_fn alloc;
+  void *ud;
+} mpack_sbuf_t;
+
+MPACK_API void mpack_writer_init(mpack_writer_t *w, char *buf, size_t buflen)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_nil(mpack_writer_t *w) FUNUSED FNONULL;
+MPACK_API int mpack_w_boolean(mpack_writer_t *w, unsigned v) FUNUSED FNONULL;
+MPACK_API int mpack_w_uint(mpack_writer_t *w, mpack_uintmax_t v)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_sint(mpack_writer_t *w, mpack_sintmax_t v)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_double(mpack_writer_t *w, double v) FUNUSED FNONULL;
+MPACK_API int mpack_w_number(mpack_writer_t *w, double v) FUNUSED FNONULL;
+MPACK_API int mpack_w_str(mpack_writer_t *w, const char *s, mpack_uint32_t l)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_bin(mpack_writer_t *w, const char *s, mpack_uint32_t l)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_array(mpack_writer_t *w, mpack_uint32_t l)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_map(mpack_writer_t *w, mpack_uint32_t l)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_uint_array(mpack_writer_t *w, const mpack_uintmax_t *v,
+    size_t n, size_t *written) FUNUSED FNONULL;
+MPACK_API int mpack_w_sint_array(mpack_writer_t *w, const mpack_sintmax_t *v,
+    size_t n, size_t *written) FUNUSED FNONULL;
+MPACK_API int mpack_w_float_array(mpack_writer_t *w, const float *v,
+    size_t n, size_t *written) FUNUSED FNONULL;
+MPACK_API int mpack_w_double_array(mpack_writer_t *w, const double *v,
+    size_t n, size_t *written) FUNUSED FNONULL;
+MPACK_API int mpack_w_number_array(mpack_writer_t *w, const double *v,
+    size_t n, size_t *written) FUNUSED FNONULL;
+MPACK_API int mpack_w_array_open(mpack_writer_t *w, mpack_uint32_t bound)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_map_open(mpack_writer_t *w, mpack_uint32_t bound)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_close(mpack_writer_t *w, mpack_uint32_t count)
+  FUNUSED FNONULL;
+MPACK_API int mpack_w_compact(char *buf, size_t *buflen) FUNUSED FNONULL;
+MPACK_API void mpack_iowriter_init(mpack_iowriter_t *w, mpack_iovec_t *iov,
+    size_t iovcap, char *buf, size_t buflen, size_t threshold) FUNUSED FNONULL;
+MPACK_API void mpack_iowriter_reset(mpack_iowriter_t *w) FUNUSED FNONULL;
+MPACK_API int mpack_iowrite(mpack_iowriter_t *w, const mpack_token_t *tok)
+  FUNUSED FNONULL;
+MPACK_API void mpack_sbuf_init(mpack_sbuf_t *s, mpack_alloc_fn alloc,
+    void *ud) FUNUSED FNONULL_ARG((1,2));
+MPACK_API void mpack_sbuf_destroy(mpack_sbuf_t *s) FUNUSED FNONULL;
+MPACK_API int mpack_sbuf_reserve(mpack_sbuf_t *s, size_t n) FUNUSED FNONULL;
+MPACK_API int mpack_write_sbuf(mpack_sbuf_t *s, const mpack_token_t *tok)
+  FUNUSED FNONULL;
+MPACK_API int mpack_unparse_sbuf(mpack_sbuf_t *s, mpack_parser_t *parser,
+    mpack_walk_cb enter_cb, mpack_walk_cb exit_cb) FUNUSED FNONULL;
+
+#endif  /* MPACK_WRITER_H */
@@ -65,6 +65,19 @@ static uint32_t item_count(const char *s)
   return count;
 }
 
+static size_t alloc_limit = SIZE_MAX;
+
+static void *test_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+  (void)ud;
+  (void)osize;
+  if (!nsize) {
+    free(ptr);
+    return NULL;
+  }
+  return nsize > alloc_limit ? NULL : realloc(ptr, nsize);
+}
+
 static void unparse_enter(mpack_parser_t *parser, mpack_node_t *node)
 {
   mpack_node_t *parent = MPACK_PARENT_NODE(node);
@@ -125,8 +138,8 @@ static void unparse_enter(mpack_parser_t *parser, mpack_node_t *node)
             /* test both pack_float implementations */
             mpack_token_t tok = mpack_pack_float_compat(d);
             (void)(tok);
-            assert(node->tok.data.value.lo == tok.data.value.lo &&
-                node->tok.data.value.hi == tok.data.value.hi);
+            assert(!memcmp(&node->tok.data.value, &tok.data.value,
+                  sizeof(tok.data.value)));
           }
         } else {
           node->tok = mpack_pack_sint((mpack_sintmax_t)strtoll(tmp, NULL, 10));
@@ -274,26 +287,83 @@ static void parse_exit(mpack_parser_t *parser, mpack_node_t *node)
   }
 }
 
+MPACK_DEFINE_PARSE(parse_generated, parse_enter, parse_exit)
+
+/* mpack_cparser_t callbacks: parsing records the tokens, unparsing replays
+ * them. User data of each node is the 1-based index of its token. */
+static mpack_token_t *ctoks;
+static size_t ctokcount, ctokcap, ctokpos;
+static bool cparser_ok;
+
+static void cparse_enter(mpack_cparser_t *parser, mpack_cnode_t *node)
+{
+  mpack_cnode_t *parent = MPACK_CPARENT_NODE(parser, node);
+  mpack_data_t *data = MPACK_CNODE_DATA(parser, node);
+  for (mpack_uint32_t i = 0; i < parser->slots; i++) {
+    if (data[i].p) cparser_ok = false;
+  }
+  if (parent && !MPACK_CNODE_DATA(parser, parent)->u) cparser_ok = false;
+  if (ctokcount == ctokcap) {
+    ctokcap = ctokcap ? ctokcap * 2 : 64;
+    ctoks = realloc(ctoks, sizeof(*ctoks) * ctokcap);
+  }
+  ctoks[ctokcount++] = parser->tok;
+  data->u = ctokcount;
+}
+
+static void cparse_exit(mpack_cparser_t *parser, mpack_cnode_t *node)
+{
+  mpack_token_t *tok = ctoks + MPACK_CNODE_DATA(parser, node)->u - 1;
+  if (tok->type != node->type || tok->length != node->length) {
+    cparser_ok = false;
+  }
+}
+
+static void cunparse_enter(mpack_cparser_t *parser, mpack_cnode_t *node)
+{
+  (void)node;
+  parser->tok = ctoks[ctokpos++];
+}
+
+static void cunparse_exit(mpack_cparser_t *parser, mpack_cnode_t *node)
+{
+  (void)parser;
+  (void)node;
+}
+
 /* Each unpack/pack test is executed multiple times, with each feeding data in
  * chunks of different sizes. */
 static const size_t chunksizes[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, SIZE_MAX};
 
-static void fixture_test(const struct fixture *ff, int fixture_idx)
+/* A fixture loaded by each_fixture, `repr` is the start of its json. */
+struct fixture_data {
+  char *json;
+  uint8_t *msgpack;
+  size_t msgpacklen;
+  char repr[32];
+};
+
+/* Run `check` on every fixture of `ff`. */
+static void each_fixture(const struct fixture *ff, int count,
+    void (*check)(const struct fixture_data *fd))
 {
-  const struct fixture *f = ff + fixture_idx;
-  char *fjson;
-  uint8_t *fmsgpack;
-  size_t fmsgpacklen;
-  if (f->generator) {
-    f->generator(&fjson, &fmsgpack, &fmsgpacklen, f->generator_size);
-  } else {
-    fjson = f->json;
-    fmsgpack = f->msgpack;
-    fmsgpacklen = f->msgpacklen;
+  for (int i = 0; i < count; i++) {
+    const struct fixture *f = ff + i;
+    struct fixture_data fd;
+    if (f->generator) {
+      f->generator(&fd.json, &fd.msgpack, &fd.msgpacklen, f->generator_size);
+    } else {
+      fd.json = f->json;
+      fd.msgpack = f->msgpack;
+      fd.msgpacklen = f->msgpacklen;
+    }
+    snprintf(fd.repr, sizeof(fd.repr), "%s", fd.json);
+    check(&fd);
   }
+}
 
-  char repr[32];
-  snprintf(repr, sizeof(repr), "%s", fjson);
+static void fixture_test(const struct fixture_data *fd)
+{
   for (size_t i = 0; i < ARRAY_SIZE(chunksizes); i++) {
     mpack_parser_t parser;
     size_t cs = chunksizes[i];
@@ -303,7 +373,7 @@ static void fixture_test(const struct fixture *ff, int fixture_idx)
     /* unpack test */
     bufpos = 0;
     mpack_parser_init(&parser, 0);
-    b = (char *)fmsgpack;
+    b = (char *)fd->msgpack;
     bl = cs;
 
     do {
@@ -314,15 +384,15 @@ static void fixture_test(const struct fixture *ff, int fixture_idx)
       }
     } while (s);
 
-    is(buf, fjson, cs == SIZE_MAX ?
+    is(buf, fd->json, cs == SIZE_MAX ?
         "unpack '%s' in a single step" :
-        "unpack '%s' in steps of %zu", repr, cs);
+        "unpack '%s' in steps of %zu", fd->repr, cs);
 
     /* pack test */
     mpack_parser_init(&parser, 0);
     b = buf;
     bl = MIN(cs, sizeof(buf));
-    parser.data.p = fjson;
+    parser.data.p = fd->json;
     do {
       s = mpack_unparse(&parser, &b, &bl, unparse_enter, unparse_exit);
       if (s) {
@@ -331,12 +401,152 @@ static void fixture_test(const struct fixture *ff, int fixture_idx)
       }
     } while (s);
 
-    cmp_mem(buf, fmsgpack, fmsgpacklen, cs == SIZE_MAX ?
+    cmp_mem(buf, fd->msgpack, fd->msgpacklen, cs == SIZE_MAX ?
         "pack '%s' in a single step" :
-        "pack '%s' in steps of %zu", repr, cs);
+        "pack '%s' in steps of %zu", fd->repr, cs);
   }
 }
 
+static void next_event_check(const struct fixture_data *fd)
+{
+  mpack_parser_t parser;
+  bool events_ok = true;
+  const size_t event_chunksizes[] = {1, SIZE_MAX};
+  for (size_t i = 0; i < ARRAY_SIZE(event_chunksizes); i++) {
+    /* drive the same callbacks from the pull api */
+    size_t cs = event_chunksizes[i];
+    const char *b = (const char *)fd->msgpack;
+    size_t bl = MIN(cs, fd->msgpacklen), left = fd->msgpacklen;
+    mpack_uint32_t depth = 0;
+    mpack_event_t ev;
+    int s;
+    bufpos = 0;
+    mpack_parser_init(&parser, 0);
+    for (;;) {
+      left -= bl;
+      s = mpack_next_event(&parser, &b, &bl, &ev);
+      left += bl;
+      if (s == MPACK_EOF && left) {
+        bl = MIN(cs, left);
+        continue;
+      } else if (s) {
+        events_ok = false;
+        break;
+      }
+      if (ev.type == MPACK_EVENT_ENTER) {
+        parse_enter(&parser, ev.node);
+        depth++;
+      } else {
+        parse_exit(&parser, ev.node);
+        depth--;
+      }
+      if (ev.depth != depth + (ev.type == MPACK_EVENT_EXIT) ||
+          ev.parent != MPACK_PARENT_NODE(ev.node)) {
+        events_ok = false;
+      }
+      if (ev.type == MPACK_EVENT_EXIT && ev.depth == 1) break;
+    }
+    events_ok = events_ok && !left && !strcmp(buf, fd->json);
+  }
+  ok(events_ok, "unpack '%s' with mpack_next_event", fd->repr);
+}
+
+static void cparser_check(const struct fixture_data *fd)
+{
+  /* two user data slots, fed byte by byte and moved to a copy after each
+   * byte, then one slot in one step */
+  MPACK_CPARSER_STRUCT(MPACK_MAX_OBJECT_DEPTH, 2) dual[2];
+  int cur = 0;
+  mpack_cparser_t cparser;
+  mpack_tokbuf_t tb;
+  const char *b = (const char *)fd->msgpack;
+  /* the tokens may be written in a shorter form than the fixture(see
+   * write_batch_test), so compare with the output of mpack_write */
+  size_t bl = 1, left = fd->msgpacklen - 1, outlen = fd->msgpacklen * 9 + 1;
+  size_t explen = outlen;
+  char *out = malloc(outlen * 2), *outp = out, *exp = out + outlen;
+  char *expp = exp;
+  int s;
+  cparser_ok = true;
+  ctokcount = 0;
+  mpack_cparser_init((mpack_cparser_t *)dual, MPACK_MAX_OBJECT_DEPTH, 2);
+  while ((s = mpack_cparse((mpack_cparser_t *)(dual + cur), &b, &bl,
+          cparse_enter, cparse_exit)) == MPACK_EOF && left) {
+    dual[!cur] = dual[cur];
+    memset(dual + cur, 0xff, sizeof(dual[cur]));
+    cur = !cur;
+    bl = 1;
+    left--;
+  }
+  cparser_ok = cparser_ok && s == MPACK_OK && !left;
+  b = (const char *)fd->msgpack;
+  bl = fd->msgpacklen;
+  ctokcount = 0;
+  mpack_cparser_init(&cparser, 0, 0);
+  cparser_ok = cparser_ok && cparser.slots == 1 &&
+    mpack_cparse(&cparser, &b, &bl, cparse_enter, cparse_exit) == MPACK_OK;
+  mpack_tokbuf_init(&tb);
+  for (size_t i = 0; i < ctokcount; i++) {
+    if (mpack_write(&tb, &expp, &explen, ctoks + i)) cparser_ok = false;
+  }
+  ctokpos = 0;
+  mpack_cparser_init(&cparser, 0, 0);
+  cparser_ok = cparser_ok &&
+    mpack_cunparse(&cparser, &outp, &outlen, cunparse_enter,
+        cunparse_exit) == MPACK_OK && ctokpos == ctokcount &&
+    outp - out == expp - exp && !memcmp(out, exp, (size_t)(expp - exp));
+  ok(cparser_ok, "walk '%s' with a compact parser", fd->repr);
+  free(out);
+}
+
+static void generated_parse_check(const struct fixture_data *fd)
+{
+  mpack_parser_t parser;
+  const char *b = (const char *)fd->msgpack;
+  size_t bl = 1, left = fd->msgpacklen - 1;
+  int s;
+  bufpos = 0;
+  mpack_parser_init(&parser, 0);
+  while ((s = parse_generated(&parser, &b, &bl)) == MPACK_EOF && left) {
+    bl = 1;
+    left--;
+  }
+  ok(s == MPACK_OK && !left && !strcmp(buf, fd->json),
+      "unpack '%s' with MPACK_DEFINE_PARSE in steps of 1", fd->repr);
+}
+
+static void unparse_size_check(const struct fixture_data *fd)
+{
+  mpack_parser_t parser;
+  size_t size;
+  mpack_parser_init(&parser, 0);
+  parser.data.p = fd->json;
+  ok(!mpack_unparse_size(&parser, &size, unparse_enter, unparse_exit) &&
+      size == fd->msgpacklen,
+      "size of '%s' is computed without packing", fd->repr);
+}
+
+static void unparse_sbuf_check(const struct fixture_data *fd)
+{
+  mpack_parser_t parser;
+  mpack_sbuf_t sbuf;
+  mpack_parser_init(&parser, 0);
+  mpack_sbuf_init(&sbuf, test_alloc, NULL);
+  parser.data.p = fd->json;
+  ok(!mpack_unparse_sbuf(&sbuf, &parser, unparse_enter, unparse_exit) &&
+      sbuf.size == fd->msgpacklen &&
+      !memcmp(sbuf.data, fd->msgpack, fd->msgpacklen),
+      "pack '%s' into a growable buffer", fd->repr);
+  mpack_sbuf_destroy(&sbuf);
+}
+
+/* Checks that walk each fixture through the parse/unparse APIs, run again on
+ * number_fixtures with number_conv set. */
+static void (*const walk_checks[])(const struct fixture_data *fd) = {
+  fixture_test, next_event_check, cparser_check, generated_parse_check,
+  unparse_size_check, unparse_sbuf_check
+};
+
 static void signed_positive_packs_with_unsigned_format(void)
 {
   mpack_token_t tokbuf[0xff];
@@ -369,6 +579,16 @@ static void signed_positive_packs_with_unsigned_format(void)
   };
   cmp_mem(mpackbuf, expected, sizeof(mpackbuf) - buflen,
       "signed positive packs with unsigned format");
+
+  /* SINT tokens holding non-negative values are written as uint too */
+  mpack_token_t tok = mpack_pack_uint(200);
+  tok.type = MPACK_TOKEN_SINT;
+  buf = mpackbuf;
+  buflen = sizeof(mpackbuf);
+  ok(!mpack_write(&writer, &buf, &buflen, &tok) &&
+      mpack_token_size(&tok) == 2 && buf == mpackbuf + 2 &&
+      !memcmp(mpackbuf, "\xcc\xc8", 2),
+      "non-negative sint tokens pack with unsigned format");
 }
 
 static void positive_signed_format_unpacks_as_unsigned(void)
@@ -426,6 +646,47 @@ static void positive_signed_format_unpacks_as_unsigned(void)
       "positive signed format unpacks as unsigned(tokens)");
 }
 
+static void negative_formats_unpack_as_signed(void)
+{
+  mpack_tokbuf_t reader;
+  mpack_token_t toks[5];
+  size_t i;
+  const uint8_t input[] = {
+    0xe0,
+    0xd0, 0x80,
+    0xd1, 0x80, 0x00,
+    0xd2, 0x80, 0x00, 0x00, 0x00,
+#ifndef FORCE_32BIT_INTS
+    0xd3, 0xff, 0xff, 0xff, 0xfe, 0x00, 0x00, 0x00, 0x00
+#endif
+  };
+  const char *inp = (const char *)input;
+  size_t inplen = sizeof(input);
+  mpack_sintmax_t expected[] = {
+    -0x20,
+    -0x80,
+    -0x8000,
+    -0x7fffffff - 1,
+#ifndef FORCE_32BIT_INTS
+    -0x200000000
+#endif
+  };
+  mpack_sintmax_t actual[ARRAY_SIZE(expected)];
+  double actual_numbers[ARRAY_SIZE(expected)];
+  double expected_numbers[ARRAY_SIZE(expected)];
+  mpack_tokbuf_init(&reader);
+  for (i = 0; i < ARRAY_SIZE(expected); i++) {
+    mpack_read(&reader, &inp, &inplen, toks + i);
+    actual[i] = mpack_unpack_sint(toks[i]);
+    actual_numbers[i] = mpack_unpack_number(toks[i]);
+    expected_numbers[i] = (double)expected[i];
+  }
+  cmp_mem(expected, actual, sizeof(expected),
+      "negative formats unpack as signed");
+  cmp_mem(expected_numbers, actual_numbers, sizeof(expected_numbers),
+      "negative formats unpack as signed(numbers)");
+}
+
 static void unpacking_c1_returns_eread(void)
 {
   const uint8_t input[] = {0xc1};
@@ -499,6 +760,13 @@ static void parse_throw(void)
   throw = false;
   ok(mpack_parse((mpack_parser_t *)&parser, &b, &bl, parse_enter, parse_exit)
       == MPACK_EXCEPTION, "throw will invalidate the parser");
+  mpack_parser_init(&parser, 0);
+  b = (const char *)input;
+  bl = sizeof(input);
+  throw = true;
+  ok(parse_generated(&parser, &b, &bl) == MPACK_EXCEPTION,
+      "generated parsers stop on throw");
+  throw = false;
 }
 
 static void unparse_throw(void)
@@ -541,6 +809,61 @@ static void does_not_write_invalid_tokens(void)
       "does not write invalid tokens 2");
 }
 
+static bool token_equal(const mpack_token_t *a, const mpack_token_t *b)
+{
+  if (a->type != b->type || a->length != b->length) return false;
+  switch (a->type) {
+    case MPACK_TOKEN_CHUNK:
+      return a->data.chunk_ptr == b->data.chunk_ptr;
+    case MPACK_TOKEN_EXT:
+      return a->data.ext_type == b->data.ext_type;
+    case MPACK_TOKEN_BIN:
+    case MPACK_TOKEN_STR:
+    case MPACK_TOKEN_ARRAY:
+    case MPACK_TOKEN_MAP:
+      return true;
+    default:
+      return !memcmp(&a->data.value, &b->data.value, sizeof(a->data.value));
+  }
+}
+
+static void read_batch_check(const struct fixture_data *fd)
+{
+  bool equal = true;
+  for (size_t i = 0; i < ARRAY_SIZE(chunksizes) && equal; i++) {
+    mpack_tokbuf_t reader = MPACK_TOKBUF_INITIAL_VALUE;
+    mpack_tokbuf_t batch_reader = MPACK_TOKBUF_INITIAL_VALUE;
+    size_t cs = chunksizes[i];
+    size_t off = 0;
+
+    while (off < fd->msgpacklen && equal) {
+      const char *b = (const char *)fd->msgpack + off;
+      size_t bl = MIN(cs, fd->msgpacklen - off);
+      const char *bb = b;
+      size_t bbl = bl;
+      off += bl;
+
+      while (bl && equal) {
+        mpack_token_t toks[7];
+        size_t count = mpack_read_batch(&batch_reader, &bb, &bbl, toks,
+            ARRAY_SIZE(toks));
+        for (size_t j = 0; j < count && equal; j++) {
+          mpack_token_t tok;
+          equal = mpack_read(&reader, &b, &bl, &tok) == MPACK_OK &&
+            token_equal(&tok, toks + j);
+        }
+        if (count < ARRAY_SIZE(toks) && bl) {
+          mpack_token_t tok;
+          equal = mpack_read(&reader, &b, &bl, &tok) == MPACK_EOF;
+        }
+      }
+      equal = equal && bb == b && bbl == bl;
+    }
+  }
+
+  ok(equal, "read_batch matches read for '%s'", fd->repr);
+}
+
 #define MSGPACK_BUFLEN 0xff
 
 static void to_msgpack(const char *json, uint8_t **buf)
@@ -720,19 +1043,1144 @@ static void rpc_fixture_test(int fixture_idx)
   }
 }
 
+static void skip_check(const struct fixture_data *fd)
+{
+  bool skipped = true;
+  for (size_t i = 0; i < ARRAY_SIZE(chunksizes) && skipped; i++) {
+    mpack_tokbuf_t tokbuf = MPACK_TOKBUF_INITIAL_VALUE;
+    mpack_uint32_t state = 0;
+    int status = MPACK_EOF;
+    size_t cs = chunksizes[i];
+    size_t off = 0;
+
+    while (off < fd->msgpacklen && status == MPACK_EOF) {
+      const char *b = (const char *)fd->msgpack + off;
+      size_t bl = MIN(cs, fd->msgpacklen - off);
+      off += bl;
+      status = mpack_skip(&tokbuf, &b, &bl, &state);
+      /* only the last chunk may be partially consumed */
+      off -= bl;
+    }
+    skipped = status == MPACK_OK && off == fd->msgpacklen && state == 0;
+  }
+
+  ok(skipped, "skip consumes exactly '%s'", fd->repr);
+}
+
+static void skip_stops_at_value_boundary(void)
+{
+  mpack_tokbuf_t tokbuf = MPACK_TOKBUF_INITIAL_VALUE;
+  mpack_uint32_t state = 0;
+  /* {"a": [1, "bc"], "d": {}} followed by 7 */
+  const uint8_t input[] = {
+    0x82, 0xa1, 'a', 0x92, 0x01, 0xa2, 'b', 'c', 0xa1, 'd', 0x80, 0x07
+  };
+  const char *b = (const char *)input;
+  size_t bl = sizeof(input);
+  int status = mpack_skip(&tokbuf, &b, &bl, &state);
+  ok(status == MPACK_OK && bl == 1 && *b == 7 && state == 0,
+      "skip stops at value boundary");
+  b = "\xc1";
+  bl = 1;
+  ok(mpack_skip(&tokbuf, &b, &bl, &state) == MPACK_ERROR,
+      "skip returns MPACK_ERROR for invalid input");
+}
+
+static void validate_check(const struct fixture_data *fd)
+{
+  mpack_limits_t limits = {
+    MPACK_VALIDATE_MAX_DEPTH, 0xffffffff, 0xffffffff
+  };
+  const char *msg = (const char *)fd->msgpack;
+  size_t len = fd->msgpacklen;
+  char *trailing = malloc(len + 1);
+  memcpy(trailing, msg, len);
+  trailing[len] = 0;
+  ok(mpack_validate(msg, len, &limits) == MPACK_OK &&
+      mpack_validate(msg, len - 1, &limits) == MPACK_EOF &&
+      mpack_validate(trailing, len + 1, &limits) == MPACK_ERROR,
+      "validate '%s'", fd->repr);
+  free(trailing);
+}
+
+static void validate_enforces_limits(void)
+{
+  mpack_limits_t limits = {2, 2, 2};
+  /* [[1], "ab"] */
+  const char ok_input[] = "\x92\x91\x01\xa2\x61\x62";
+  /* [[[]]] */
+  const char deep[] = "\x91\x91\x90";
+  /* [1, 2, 3] */
+  const char long_array[] = "\x93\x01\x02\x03";
+  /* {"a": 1, "b": 2, "c": 3} */
+  const char long_map[] = "\x83\xa1\x61\x01\xa1\x62\x02\xa1\x63\x03";
+  /* "abc" */
+  const char long_str[] = "\xa3\x61\x62\x63";
+  ok(mpack_validate(ok_input, sizeof(ok_input) - 1, &limits) == MPACK_OK,
+      "validate accepts values within limits");
+  ok(mpack_validate(deep, sizeof(deep) - 1, &limits) == MPACK_ERROR,
+      "validate enforces depth limit");
+  ok(mpack_validate(long_array, sizeof(long_array) - 1, &limits) ==
+      MPACK_ERROR, "validate enforces array length limit");
+  ok(mpack_validate(long_map, sizeof(long_map) - 1, &limits) == MPACK_ERROR,
+      "validate enforces map length limit");
+  ok(mpack_validate(long_str, sizeof(long_str) - 1, &limits) == MPACK_ERROR,
+      "validate enforces blob size limit");
+  ok(mpack_validate("\x91\xc1", 2, &limits) == MPACK_ERROR,
+      "validate rejects 0xc1");
+  limits.depth = MPACK_VALIDATE_MAX_DEPTH + 1;
+  ok(mpack_validate("\x01", 1, &limits) == MPACK_ERROR,
+      "validate rejects a depth limit over MPACK_VALIDATE_MAX_DEPTH");
+  limits.depth = MPACK_VALIDATE_MAX_DEPTH;
+  ok(mpack_validate("\x91\x01", 2, &limits) == MPACK_OK,
+      "validate accepts a depth limit of MPACK_VALIDATE_MAX_DEPTH");
+}
+
+static void tape_check(const struct fixture_data *fd)
+{
+  /* count the tokens that should be recorded */
+  mpack_tokbuf_t reader = MPACK_TOKBUF_INITIAL_VALUE;
+  const char *b = (const char *)fd->msgpack;
+  size_t bl = fd->msgpacklen;
+  mpack_uint32_t count = 0;
+  while (bl) {
+    mpack_token_t tok;
+    int s = mpack_read(&reader, &b, &bl, &tok);
+    assert(s == MPACK_OK);
+    if (s) break;
+    if (tok.type != MPACK_TOKEN_CHUNK) count++;
+  }
+
+  mpack_tape_t tape;
+  mpack_tape_entry_t *entries = malloc(sizeof(*entries) * count);
+  mpack_tape_init(&tape, entries, count);
+  b = (const char *)fd->msgpack;
+  bl = fd->msgpacklen;
+  ok(mpack_tape_build(&tape, &b, &bl) == MPACK_OK && !bl &&
+      tape.size == count && entries[0].next == count,
+      "tape records every token of '%s'", fd->repr);
+  mpack_tape_init(&tape, entries, count - 1);
+  b = (const char *)fd->msgpack;
+  bl = fd->msgpacklen;
+  ok(count == 1 || (mpack_tape_build(&tape, &b, &bl) == MPACK_NOMEM &&
+        bl == fd->msgpacklen), "tape capacity is enforced for '%s'", fd->repr);
+  free(entries);
+}
+
+static void tape_skip_pointers(void)
+{
+  mpack_tape_entry_t entries[16];
+  mpack_tape_t tape;
+  /* [[1, 2], "ab", {"c": []}] 3 */
+  const char input[] =
+    "\x93\x92\x01\x02\xa2\x61\x62\x81\xa1\x63\x90\x03";
+  const char *b = input;
+  size_t bl = sizeof(input) - 1;
+  mpack_uint32_t expected_next[] = {8, 4, 3, 4, 5, 8, 7, 8};
+  size_t expected_offset[] = {1, 2, 3, 4, 5, 8, 9, 11};
+  mpack_uint32_t next[ARRAY_SIZE(expected_next)];
+  size_t offset[ARRAY_SIZE(expected_offset)];
+  mpack_tape_init(&tape, entries, ARRAY_SIZE(entries));
+  ok(mpack_tape_build(&tape, &b, &bl) == MPACK_OK && bl == 1 && *b == 3 &&
+      tape.size == ARRAY_SIZE(expected_next), "tape stops at value boundary");
+  for (size_t i = 0; i < ARRAY_SIZE(expected_next); i++) {
+    next[i] = entries[i].next;
+    offset[i] = entries[i].offset;
+  }
+  cmp_mem(next, expected_next, sizeof(next), "tape skip pointers");
+  cmp_mem(offset, expected_offset, sizeof(offset), "tape offsets");
+  b = input;
+  bl = 6;
+  ok(mpack_tape_build(&tape, &b, &bl) == MPACK_EOF && bl == 6,
+      "tape returns MPACK_EOF for truncated input");
+}
+
+static void cursor_field_access(void)
+{
+  /* {"method": "foo", "params": [1, {"bufnr": 5}, "x"], "id": 7} 9 */
+  const char input[] =
+    "\x83\xa6method\xa3\x66\x6f\x6f"
+    "\xa6params\x93\x01\x81\xa5\x62\x75\x66\x6e\x72\x05\xa1x"
+    "\xa2id\x07\x09";
+  mpack_cursor_t cursor;
+  mpack_uint32_t len;
+  mpack_uintmax_t u;
+  mpack_token_t tok;
+  const char *str;
+  size_t slen;
+  mpack_cursor_init(&cursor, input, sizeof(input) - 1);
+  ok(mpack_cursor_enter_map(&cursor, &len) == MPACK_OK && len == 3,
+      "cursor enters map");
+  ok(mpack_cursor_find_key(&cursor, "id") == MPACK_OK &&
+      mpack_cursor_get_uint(&cursor, &u) == MPACK_OK && u == 7,
+      "cursor finds key");
+  ok(mpack_cursor_find_key(&cursor, "method") == MPACK_OK &&
+      mpack_cursor_get_str(&cursor, &str, &slen) == MPACK_OK &&
+      slen == 3 && !memcmp(str, "foo", 3),
+      "cursor finds keys before the current position");
+  ok(mpack_cursor_find_key(&cursor, "missing") == MPACK_NOTFOUND,
+      "cursor reports missing keys");
+  ok(MPACK_NOTFOUND > MPACK_RPC_ERESPID && MPACK_ETYPE > MPACK_NOTFOUND,
+      "cursor status codes are distinct from the rpc ones");
+  ok(mpack_cursor_find_key(&cursor, "params") == MPACK_OK &&
+      mpack_cursor_get_uint(&cursor, &u) == MPACK_ETYPE &&
+      mpack_cursor_enter_array(&cursor, &len) == MPACK_OK && len == 3 &&
+      mpack_cursor_next(&cursor) == MPACK_OK &&
+      mpack_cursor_enter_map(&cursor, &len) == MPACK_OK &&
+      mpack_cursor_find_key(&cursor, "bufnr") == MPACK_OK &&
+      mpack_cursor_get_uint(&cursor, &u) == MPACK_OK && u == 5 &&
+      mpack_cursor_peek(&cursor, &tok) == MPACK_EOF &&
+      mpack_cursor_leave(&cursor) == MPACK_OK &&
+      mpack_cursor_peek(&cursor, &tok) == MPACK_OK &&
+      tok.type == MPACK_TOKEN_STR,
+      "cursor walks nested containers");
+  ok(mpack_cursor_leave(&cursor) == MPACK_OK &&
+      mpack_cursor_leave(&cursor) == MPACK_OK &&
+      mpack_cursor_get_uint(&cursor, &u) == MPACK_OK && u == 9 &&
+      mpack_cursor_next(&cursor) == MPACK_EOF,
+      "cursor leaves containers with unread items");
+  mpack_cursor_init(&cursor, input, 10);
+  ok(mpack_cursor_enter_map(&cursor, &len) == MPACK_OK &&
+      mpack_cursor_find_key(&cursor, "id") == MPACK_ERROR,
+      "cursor returns MPACK_ERROR for truncated input");
+}
+
+static void extract_path(void)
+{
+  /* {"method": "foo", "params": [1, {"bufnr": 5}, "x"], "id": 7} */
+  const char input[] =
+    "\x83\xa6method\xa3\x66\x6f\x6f"
+    "\xa6params\x93\x01\x81\xa5\x62\x75\x66\x6e\x72\x05\xa1x"
+    "\xa2id\x07";
+  const mpack_path_t bufnr[] = {{"params", 0}, {NULL, 1}, {"bufnr", 0}};
+  const mpack_path_t x[] = {{"params", 0}, {NULL, 2}};
+  const mpack_path_t params[] = {{"params", 0}};
+  const mpack_path_t missing[] = {{"params", 0}, {NULL, 3}};
+  const mpack_path_t missing_key[] = {{"param", 0}};
+  mpack_span_t span;
+  ok(mpack_extract(input, sizeof(input) - 1, bufnr, 3, &span) == MPACK_OK &&
+      span.offset == 28 && span.length == 1 &&
+      span.tok.type == MPACK_TOKEN_UINT && mpack_unpack_uint(span.tok) == 5,
+      "extract nested map value");
+  ok(mpack_extract(input, sizeof(input) - 1, x, 2, &span) == MPACK_OK &&
+      span.offset == 29 && span.length == 2 &&
+      span.tok.type == MPACK_TOKEN_STR && span.tok.length == 1,
+      "extract array item");
+  ok(mpack_extract(input, sizeof(input) - 1, params, 1, &span) == MPACK_OK &&
+      span.offset == 19 && span.length == 12 &&
+      span.tok.type == MPACK_TOKEN_ARRAY, "extract container");
+  ok(mpack_extract(input, sizeof(input) - 1, missing, 2, &span) ==
+      MPACK_NOTFOUND, "extract out of bounds index");
+  ok(mpack_extract(input, sizeof(input) - 1, missing_key, 1, &span) ==
+      MPACK_NOTFOUND, "extract missing key");
+
+  bool found = true;
+  for (size_t i = 0; i < ARRAY_SIZE(chunksizes) && found; i++) {
+    mpack_extractor_t extractor;
+    int status = MPACK_EOF;
+    size_t off = 0;
+    mpack_extractor_init(&extractor, bufnr, 3);
+    while (status == MPACK_EOF && off < sizeof(input) - 1) {
+      const char *b = input + off;
+      size_t bl = MIN(chunksizes[i], sizeof(input) - 1 - off);
+      off += bl;
+      status = mpack_extractor_run(&extractor, &b, &bl);
+      off -= bl;
+    }
+    found = status == MPACK_OK && off == 29 &&
+      extractor.span.offset == 28 && extractor.span.length == 1 &&
+      mpack_unpack_uint(extractor.span.tok) == 5;
+  }
+  ok(found, "extract from split buffers");
+}
+
+static char query_out[7][64];
+
+static void query_cb(mpack_matcher_t *m, mpack_uint32_t id,
+    const mpack_token_t *tok)
+{
+  char *out = query_out[id];
+  size_t len = strlen(out);
+  (void)m;
+  switch (tok->type) {
+    case MPACK_TOKEN_UINT:
+      snprintf(out + len, sizeof(query_out[0]) - len, "u%u;",
+          (unsigned)mpack_unpack_uint(*tok));
+      break;
+    case MPACK_TOKEN_CHUNK:
+      snprintf(out + len, sizeof(query_out[0]) - len, "%.*s",
+          (int)tok->length, tok->data.chunk_ptr);
+      break;
+    default:
+      snprintf(out + len, sizeof(query_out[0]) - len, "%d:%u;",
+          tok->type, (unsigned)tok->length);
+      break;
+  }
+}
+
+static void query_patterns(void)
+{
+  /* {"method": "foo", "params": [1, {"bufnr": 5}, "x"], "id": 7} */
+  const char input[] =
+    "\x83\xa6method\xa3\x66\x6f\x6f"
+    "\xa6params\x93\x01\x81\xa5\x62\x75\x66\x6e\x72\x05\xa1x"
+    "\xa2id\x07";
+  const mpack_path_t bufnr[] = {{"params", 0}, {NULL, 1}, {"bufnr", 0}};
+  const mpack_path_t params[] = {{"params", 0}, {NULL, MPACK_PATH_ANY}};
+  const mpack_path_t method[] = {{"method", 0}};
+  const mpack_path_t id[] = {{"id", 0}};
+  const mpack_path_t any[] = {{NULL, MPACK_PATH_ANY}};
+  const mpack_path_t nothing[] = {{"nothing", 0}, {NULL, MPACK_PATH_ANY}};
+  const char *expected[] = {
+    "u5;",
+    "u1;8:1;10:1;x",
+    "10:3;foo",
+    "u7;",
+    "10:3;foo7:3;u7;",
+    "u5;",
+    ""
+  };
+  mpack_query_node_t nodes[16];
+  mpack_query_t query;
+  mpack_query_init(&query, nodes, ARRAY_SIZE(nodes));
+  ok(!mpack_query_add(&query, bufnr, 3, 0) &&
+      !mpack_query_add(&query, params, 2, 1) &&
+      !mpack_query_add(&query, method, 1, 2) &&
+      !mpack_query_add(&query, id, 1, 3) &&
+      !mpack_query_add(&query, any, 1, 4) &&
+      !mpack_query_add(&query, bufnr, 3, 5) &&
+      !mpack_query_add(&query, nothing, 2, 6) &&
+      query.size == 11, "query compiles patterns into a trie");
+
+  bool matched = true;
+  for (size_t i = 0; i < ARRAY_SIZE(chunksizes) && matched; i++) {
+    mpack_matcher_t matcher;
+    int status = MPACK_EOF;
+    size_t off = 0;
+    memset(query_out, 0, sizeof(query_out));
+    mpack_matcher_init(&matcher, &query, query_cb);
+    while (status == MPACK_EOF && off < sizeof(input) - 1) {
+      const char *b = input + off;
+      size_t bl = MIN(chunksizes[i], sizeof(input) - 1 - off);
+      off += bl;
+      status = mpack_matcher_run(&matcher, &b, &bl);
+      off -= bl;
+    }
+    matched = status == MPACK_OK && off == sizeof(input) - 1;
+    for (size_t j = 0; j < ARRAY_SIZE(expected) && matched; j++) {
+      matched = !strcmp(query_out[j], expected[j]);
+      if (!matched) diag("pattern %zu: '%s'", j, query_out[j]);
+    }
+  }
+  ok(matched, "query reports every match");
+}
+
+static void write_batch_check(const struct fixture_data *fd)
+{
+  /* with the whole buffer available, each payload is read as one chunk */
+  mpack_tokbuf_t reader = MPACK_TOKBUF_INITIAL_VALUE;
+  mpack_tokbuf_t writer = MPACK_TOKBUF_INITIAL_VALUE;
+  mpack_token_t *toks = malloc(sizeof(*toks) * fd->msgpacklen);
+  /* some split-mode negative integers are written back in a wider format */
+  size_t outlen = fd->msgpacklen * 9;
+  char *expected = malloc(outlen);
+  char *actual = malloc(outlen);
+  const char *b = (const char *)fd->msgpack;
+  size_t bl = fd->msgpacklen;
+  size_t count = 0;
+  char *wb = expected;
+  size_t wbl = outlen;
+  while (bl) {
+    mpack_read(&reader, &b, &bl, toks + count);
+    mpack_write(&writer, &wb, &wbl, toks + count);
+    count++;
+  }
+  size_t expectedlen = outlen - wbl;
+
+  bool equal = true;
+  for (size_t i = 0; i < ARRAY_SIZE(chunksizes) && equal; i++) {
+    mpack_tokbuf_t batch_writer = MPACK_TOKBUF_INITIAL_VALUE;
+    size_t pos = 0;
+    size_t off = 0;
+    while (pos < count && off < expectedlen) {
+      size_t written;
+      wb = actual + off;
+      wbl = MIN(chunksizes[i], expectedlen - off);
+      off += wbl;
+      mpack_write_batch(&batch_writer, &wb, &wbl, toks + pos, count - pos,
+          &written);
+      pos += written;
+      off -= wbl;
+    }
+    equal = pos == count && off == expectedlen &&
+      !memcmp(expected, actual, expectedlen);
+  }
+
+  ok(equal, "write_batch matches write for '%s'", fd->repr);
+  free(actual);
+  free(expected);
+  free(toks);
+}
+
+static int writer_put(mpack_writer_t *w, int i)
+{
+  static const char xs[] = "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx";
+  switch (i) {
+    case 0: return mpack_w_array(w, 14);
+    case 1: return mpack_w_uint(w, 0);
+    case 2: return mpack_w_uint(w, 200);
+    case 3: return mpack_w_uint(w, 70000);
+    case 4: return mpack_w_sint(w, -1);
+    case 5: return mpack_w_sint(w, -33);
+    case 6: return mpack_w_sint(w, -129);
+    case 7: return mpack_w_sint(w, -40000);
+    case 8: return mpack_w_nil(w);
+    case 9: return mpack_w_boolean(w, 1);
+    case 10: return mpack_w_double(w, 0.5);
+    case 11: return mpack_w_str(w, "hello", 5);
+    case 12: return mpack_w_str(w, xs, 40);
+    case 13: return mpack_w_bin(w, "abc", 3);
+    case 14: return mpack_w_map(w, 16);
+#ifndef FORCE_32BIT_INTS
+    case 15: return mpack_w_uint(w, 0x100000000);
+#endif
+    default: return -1;
+  }
+}
+
+static void writer_typed_values(void)
+{
+  const char expected[] =
+    "\x9e\x00\xcc\xc8\xce\x00\x01\x11\x70"
+    "\xff\xd0\xdf\xd1\xff\x7f\xd2\xff\xff\x63\xc0"
+    "\xc0\xc3\xca\x3f\x00\x00\x00"
+    "\xa5hello"
+    "\xd9\x28xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx"
+    "\xc4\x03" "abc"
+    "\xde\x00\x10"
+#ifndef FORCE_32BIT_INTS
+    "\xcf\x00\x00\x00\x01\x00\x00\x00\x00"
+#endif
+    ;
+  size_t expectedlen = sizeof(expected) - 1;
+  char out[sizeof(expected)];
+  bool equal = true, passthrough = false;
+
+  for (size_t i = 0; i < ARRAY_SIZE(chunksizes) && equal; i++) {
+    mpack_writer_t w;
+    mpack_writer_init(&w, out, MIN(chunksizes[i], expectedlen));
+    for (int v = 0; equal; v++) {
+      int status = writer_put(&w, v);
+      if (status == -1) break;
+      while (status == MPACK_EOF && w.buf < out + expectedlen) {
+        /* repeat the call with the next piece of the output buffer */
+        passthrough = passthrough || w.tokbuf.passthrough;
+        w.buflen = MIN(chunksizes[i], expectedlen - (size_t)(w.buf - out));
+        status = writer_put(&w, v);
+      }
+      equal = status == MPACK_OK;
+    }
+    equal = equal && (size_t)(w.buf - out) == expectedlen &&
+      !memcmp(out, expected, expectedlen);
+  }
+
+  ok(equal, "writer encodes typed values across split buffers");
+  ok(!passthrough, "writer doesn't use the tokbuf passthrough state");
+}
+
+static void writer_deferred_containers(void)
+{
+  char out[64];
+  const char deferred[] =
+    "\xdd\x00\x00\x00\x03\x01\xde\x00\x01\xa1k\x02\xdc\x00\x00";
+  const char compacted[] = "\x93\x01\x81\xa1k\x02\x90";
+  const char grown[] = "\xdc\x00\x02\x01\xa6" "abcdef";
+  char moved[32];
+  mpack_writer_t w;
+  size_t outlen;
+
+  mpack_writer_init(&w, out, sizeof(out));
+  bool written = !mpack_w_array_open(&w, 0xffffffff) &&
+    !mpack_w_uint(&w, 1) &&
+    !mpack_w_map_open(&w, 10) &&
+    !mpack_w_str(&w, "k", 1) &&
+    !mpack_w_uint(&w, 2) &&
+    !mpack_w_close(&w, 1) &&
+    !mpack_w_array_open(&w, 0) &&
+    !mpack_w_close(&w, 0) &&
+    !mpack_w_close(&w, 3) && !w.depth;
+  outlen = (size_t)(w.buf - out);
+  ok(written && outlen == sizeof(deferred) - 1 &&
+      !memcmp(out, deferred, outlen),
+      "writer backpatches the length of open containers");
+
+  ok(!mpack_w_compact(out, &outlen) && outlen == sizeof(compacted) - 1 &&
+      !memcmp(out, compacted, outlen),
+      "compaction shrinks reserved container headers");
+
+  mpack_writer_init(&w, out, 4);
+  ok(mpack_w_array_open(&w, 0xffffffff) == MPACK_EOF && w.buf == out &&
+      !mpack_w_map_open(&w, 0xffff) && mpack_w_close(&w, 0x10000),
+      "open containers check the space and the declared bound");
+
+  /* move the output to a bigger buffer while a container is open */
+  mpack_writer_init(&w, out, 8);
+  written = !mpack_w_array_open(&w, 2) && !mpack_w_uint(&w, 1) &&
+    mpack_w_str(&w, "abcdef", 6) == MPACK_EOF;
+  outlen = (size_t)(w.buf - out);
+  memset(moved, 0, sizeof(moved));
+  memcpy(moved, out, outlen);
+  memset(out, 0xff, sizeof(out));
+  w.start = moved;
+  w.buf = moved + outlen;
+  w.buflen = sizeof(moved) - outlen;
+  written = written && !mpack_w_str(&w, "abcdef", 6) &&
+    !mpack_w_close(&w, 2) && !w.depth;
+  outlen = (size_t)(w.buf - moved);
+  ok(written && outlen == sizeof(grown) - 1 && !memcmp(moved, grown, outlen),
+      "open containers survive moving the output buffer");
+
+  /* a failed close keeps the container open */
+  mpack_writer_init(&w, out, sizeof(out));
+  ok(!mpack_w_array_open(&w, 10) && mpack_w_close(&w, 0x10000) &&
+      w.depth == 1 && !mpack_w_close(&w, 0) && !w.depth,
+      "closing with a count over the bound leaves the container open");
+
+  /* flush the output while a container is open */
+  mpack_writer_init(&w, out, 4);
+  written = !mpack_w_array_open(&w, 2) &&
+    mpack_w_str(&w, "abcdef", 6) == MPACK_EOF;
+  w.start = w.buf = moved;
+  w.buflen = sizeof(moved);
+  ok(written && !mpack_w_str(&w, "abcdef", 6) &&
+      mpack_w_close(&w, 1) == MPACK_ERROR && w.depth == 1,
+      "closing a container whose header was flushed is an error");
+}
+
+static void iowriter_references_large_chunks(void)
+{
+  char blob[100];
+  char scratch[16];
+  char gathered[128];
+  mpack_iovec_t iov[4];
+  mpack_iowriter_t w;
+  mpack_token_t toks[5];
+  size_t len = 0;
+  char expected[128];
+  char *e = expected;
+  size_t el = sizeof(expected);
+  mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+
+  memset(blob, 'b', sizeof(blob));
+  toks[0] = mpack_pack_array(2);
+  toks[1] = mpack_pack_bin(sizeof(blob));
+  toks[2] = mpack_pack_chunk(blob, sizeof(blob));
+  toks[3] = mpack_pack_str(2);
+  toks[4] = mpack_pack_chunk("hi", 2);
+
+  bool written = true;
+  mpack_iowriter_init(&w, iov, ARRAY_SIZE(iov), scratch, sizeof(scratch), 64);
+  for (size_t i = 0; i < ARRAY_SIZE(toks); i++) {
+    written = written && !mpack_iowrite(&w, toks + i);
+    mpack_write(&tb, &e, &el, toks + i);
+  }
+  for (size_t i = 0; i < w.iovcnt; i++) {
+    memcpy(gathered + len, iov[i].iov_base, iov[i].iov_len);
+    len += iov[i].iov_len;
+  }
+  ok(written && w.iovcnt == 3 && iov[1].iov_base == blob &&
+      len == sizeof(expected) - el && !memcmp(gathered, expected, len),
+      "iowriter references large chunks and copies the rest");
+
+  mpack_iowriter_init(&w, iov, 1, scratch, 2, 64);
+  ok(!mpack_iowrite(&w, toks + 3) &&
+      mpack_iowrite(&w, toks + 2) == MPACK_EOF &&
+      mpack_iowrite(&w, toks + 1) == MPACK_EOF && w.iovcnt == 1 &&
+      iov[0].iov_len == 1,
+      "iowriter stops when vectors or buffer space run out");
+}
+
+static void sbuf_grows_and_reports_nomem(void)
+{
+  mpack_sbuf_t sbuf;
+  mpack_token_t str = mpack_pack_str(200);
+  char payload[200];
+  memset(payload, 'p', sizeof(payload));
+  mpack_token_t chunk = mpack_pack_chunk(payload, sizeof(payload));
+
+  mpack_sbuf_init(&sbuf, test_alloc, NULL);
+  ok(!mpack_write_sbuf(&sbuf, &str) && !mpack_write_sbuf(&sbuf, &chunk) &&
+      sbuf.size == 202 && sbuf.capacity == 256 &&
+      !memcmp(sbuf.data, "\xd9\xc8ppp", 5),
+      "sbuf grows geometrically while writing tokens");
+
+  alloc_limit = 300;
+  ok(mpack_write_sbuf(&sbuf, &chunk) == MPACK_NOMEM && sbuf.size == 202 &&
+      sbuf.capacity == 256, "sbuf keeps its contents when allocation fails");
+  alloc_limit = SIZE_MAX;
+  mpack_sbuf_destroy(&sbuf);
+}
+
+static void writer_numeric_arrays(void)
+{
+  mpack_uintmax_t u[64];
+  mpack_sintmax_t i[64];
+  double dv[] = {0.5, 1e300, -3};
+  float fv[] = {0.25f, -1.5f};
+  char expected[1024], out[1024];
+  mpack_writer_t w;
+  size_t n = ARRAY_SIZE(u), elen, written;
+  int status = MPACK_OK;
+
+  for (size_t k = 0; k < n; k++) {
+    u[k] = (mpack_uintmax_t)1 << (k % 32) * ((k / 32) + 1) % 64;
+    i[k] = k % 2 ? -(mpack_sintmax_t)u[k] / 2 - 1 : (mpack_sintmax_t)u[k] / 2;
+  }
+
+  mpack_writer_init(&w, expected, sizeof(expected));
+  for (size_t k = 0; k < n; k++) status |= mpack_w_uint(&w, u[k]);
+  for (size_t k = 0; k < n; k++) status |= mpack_w_sint(&w, i[k]);
+  for (size_t k = 0; k < ARRAY_SIZE(fv); k++) status |= mpack_w_double(&w, fv[k]);
+  for (size_t k = 0; k < ARRAY_SIZE(dv); k++) status |= mpack_w_double(&w, dv[k]);
+  elen = (size_t)(w.buf - expected);
+  assert(!status);
+
+  mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+  char ref[64], *rp = ref;
+  size_t rl = sizeof(ref);
+  for (size_t k = 0; k < ARRAY_SIZE(fv) + ARRAY_SIZE(dv); k++) {
+    mpack_token_t tok = mpack_pack_float(k < ARRAY_SIZE(fv) ?
+        fv[k] : dv[k - ARRAY_SIZE(fv)]);
+    mpack_write(&tb, &rp, &rl, &tok);
+  }
+  size_t reflen = (size_t)(rp - ref);
+  ok((reflen <= elen && !memcmp(expected + elen - reflen, ref, reflen)),
+      "the writer encodes floats like mpack_write");
+
+  bool equal = true;
+  for (size_t c = 0; c < ARRAY_SIZE(chunksizes) && equal; c++) {
+    size_t pos[4] = {0, 0, 0, 0};
+    int step = 0;
+    mpack_writer_init(&w, out, MIN(chunksizes[c], elen));
+    while (step < 4) {
+      switch (step) {
+        case 0: status = mpack_w_uint_array(&w, u + pos[0], n - pos[0],
+                    &written); break;
+        case 1: status = mpack_w_sint_array(&w, i + pos[1], n - pos[1],
+                    &written); break;
+        case 2: status = mpack_w_float_array(&w, fv + pos[2],
+                    ARRAY_SIZE(fv) - pos[2], &written); break;
+        default: status = mpack_w_double_array(&w, dv + pos[3],
+                     ARRAY_SIZE(dv) - pos[3], &written); break;
+      }
+      pos[step] += written;
+      if (!status) {
+        step++;
+      } else if (status != MPACK_EOF || w.buf == out + elen) {
+        break;
+      } else {
+        w.buflen = MIN(chunksizes[c], elen - (size_t)(w.buf - out));
+      }
+    }
+    equal = step == 4 && (size_t)(w.buf - out) == elen &&
+      !memcmp(out, expected, elen);
+  }
+  ok(equal, "numeric array writers match the scalar writers");
+}
+
+/* Blocks of items that can take the vector paths of the array writers, mixed
+ * with blocks that can't, compared with what mpack_write produces. */
+/* Numbers for the vector path tests: each run of 16 integers, 4 floats or 2
+ * doubles is either all the same encoding or mixed. */
+static void vector_values(mpack_uintmax_t *u, mpack_sintmax_t *s, float *f,
+    double *d, size_t n)
+{
+  const uint32_t fspecial[] = {0x7fc00000, 0x7fa00000, 0x7f800000, 0x1};
+  const uint64_t dspecial[] = {0x7ff4000000000000, 0x8000000000000000,
+    0x7ff0000000000000, 0x1};
+  uint32_t x = 1;
+
+  for (size_t k = 0; k < n; k++) {
+    x = x * 1103515245 + 12345;
+    switch (k / 16 % 4) {
+      case 0:  /* fixints only */
+        u[k] = x % 0x80;
+        s[k] = (mpack_sintmax_t)(x % 0xa0) - 0x20;
+        break;
+      case 1:  /* one item just out of the fixint range */
+        u[k] = k % 16 == 15 ? 0x80 : x % 0x80;
+        s[k] = k % 16 == 15 ? (k % 32 < 16 ? -0x21 : 0x80) :
+          (mpack_sintmax_t)(x % 0x80);
+        break;
+      case 2:  /* wider values */
+        u[k] = (mpack_uintmax_t)x << (x % 32);
+        s[k] = -(mpack_sintmax_t)(x % 0x7fffffff) * (mpack_sintmax_t)(x % 7);
+        break;
+      default:  /* fixint range limits */
+        u[k] = k % 2 ? 0x7f : 0;
+        s[k] = k % 2 ? -0x20 : 0x7f;
+        break;
+    }
+    if (k / 4 % 3 == 1) {
+      memcpy(f + k, fspecial + k % 4, sizeof(f[k]));
+    } else {
+      f[k] = (float)x / 7;
+    }
+    switch (k / 2 % 4) {
+      case 0: d[k] = (double)(x % 1000) * 0.25; break;
+      case 1: d[k] = k % 2 ? 1e300 : (double)x * 0.1; break;
+      case 2: d[k] = k % 2 ? (double)x : (double)x / 3; break;
+      default: memcpy(d + k, dspecial + k % 4, sizeof(d[k])); break;
+    }
+  }
+}
+
+static void writer_vector_paths(void)
+{
+  enum { N = 256 };
+  mpack_uintmax_t u[N];
+  mpack_sintmax_t s[N];
+  float f[N];
+  double d[N];
+  static char out[N * 4 * 9], ref[N * 4 * 9];
+  mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+  mpack_writer_t w;
+  char *rp = ref;
+  size_t rl = sizeof(ref), written;
+  int status = MPACK_OK;
+
+  vector_values(u, s, f, d, N);
+
+  for (size_t k = 0; k < 4 * N; k++) {
+    mpack_token_t tok;
+    switch (k / N) {
+      case 0: tok = mpack_pack_uint(u[k % N]); break;
+      case 1: tok = mpack_pack_sint(s[k % N]); break;
+      case 2: tok = mpack_pack_float((double)f[k % N]); break;
+      default: tok = mpack_pack_float(d[k % N]); break;
+    }
+    status |= mpack_write(&tb, &rp, &rl, &tok);
+  }
+  assert(!status);
+
+  mpack_writer_init(&w, out, sizeof(out));
+  status = mpack_w_uint_array(&w, u, N, &written) ||
+    mpack_w_sint_array(&w, s, N, &written) ||
+    mpack_w_float_array(&w, f, N, &written) ||
+    mpack_w_double_array(&w, d, N, &written);
+  ok((!status && w.buf - out == rp - ref &&
+      !memcmp(out, ref, (size_t)(rp - ref))),
+      "array writers match mpack_write on blocks of mixed encodings");
+}
+
+/* Decode `n` numbers of one kind(0 to 3 for uint, sint, float and double)
+ * feeding the reader `chunk` bytes at a time. */
+static bool read_numbers_chunked(int kind, const char *in, size_t len,
+    size_t chunk, void *dst, size_t n)
+{
+  mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+  size_t done = 0, off = 0;
+  int status = MPACK_EOF;
+
+  while (status == MPACK_EOF && off < len) {
+    const char *b = in + off;
+    size_t bl = MIN(chunk, len - off), read = 0;
+    switch (kind) {
+      case 0:
+        status = mpack_read_uint_array(&tb, &b, &bl,
+            (mpack_uintmax_t *)dst + done, n - done, &read);
+        break;
+      case 1:
+        status = mpack_read_sint_array(&tb, &b, &bl,
+            (mpack_sintmax_t *)dst + done, n - done, &read);
+        break;
+      case 2:
+        status = mpack_read_float_array(&tb, &b, &bl, (float *)dst + done,
+            n - done, &read);
+        break;
+      default:
+        status = mpack_read_double_array(&tb, &b, &bl, (double *)dst + done,
+            n - done, &read);
+        break;
+    }
+    done += read;
+    off = (size_t)(b - in);
+  }
+  return status == MPACK_OK && done == n && off == len;
+}
+
+static void reader_vector_paths(void)
+{
+  enum { N = 256 };
+  mpack_uintmax_t u[N];
+  mpack_sintmax_t s[N];
+  float f[N];
+  double d[N];
+  static char buf[N * 4 * 9];
+  static double whole[N], bytewise[N];
+  const char *section[5];
+  mpack_writer_t w;
+  size_t written;
+  bool equal = true;
+
+  vector_values(u, s, f, d, N);
+  mpack_writer_init(&w, buf, sizeof(buf));
+  section[0] = w.buf;
+  mpack_w_uint_array(&w, u, N, &written);
+  section[1] = w.buf;
+  mpack_w_sint_array(&w, s, N, &written);
+  section[2] = w.buf;
+  mpack_w_float_array(&w, f, N, &written);
+  section[3] = w.buf;
+  mpack_w_double_array(&w, d, N, &written);
+  section[4] = w.buf;
+
+  /* fed a byte at a time the readers can't take any vector block, so that
+   * is the scalar reference. Blocks are tried where each call starts, so the
+   * other chunk sizes move those starts around. */
+  for (int sec = 0; sec < 4; sec++) {
+    size_t len = (size_t)(section[sec + 1] - section[sec]);
+    for (int kind = 0; kind < 4; kind++) {
+      size_t chunks[] = {len, 64, 37, 20};
+      if (kind < 2 && kind != sec) continue;
+      memset(bytewise, 0, sizeof(bytewise));
+      equal = equal &&
+        read_numbers_chunked(kind, section[sec], len, 1, bytewise, N);
+      for (size_t c = 0; c < ARRAY_SIZE(chunks); c++) {
+        memset(whole, 0, sizeof(whole));
+        equal = equal &&
+          read_numbers_chunked(kind, section[sec], len, chunks[c], whole, N) &&
+          !memcmp(whole, bytewise, sizeof(whole));
+      }
+    }
+  }
+  ok(equal, "array readers match the bytewise path on mixed encodings");
+
+  {
+    /* a signaling NaN among float 32 items: whether converting it quiets it
+     * is up to the compiler, so only check that it stays a NaN */
+    const char snan[] =
+      "\xca\x3f\x80\x00\x00\xca\x7f\xa0\x00\x00"
+      "\xca\x40\x00\x00\x00\xca\x40\x40\x00\x00";
+    float fl[4];
+    equal = true;
+    for (size_t c = 1; c < sizeof(snan); c += sizeof(snan) - 2) {
+      equal = equal &&
+        read_numbers_chunked(2, snan, sizeof(snan) - 1, c, fl, 4) &&
+        fl[0] == 1 && isnan(fl[1]) && fl[2] == 2 && fl[3] == 3;
+    }
+    ok(equal, "array readers keep signaling NaNs as NaNs");
+  }
+}
+
+static void read_numeric_arrays(void)
+{
+  /* [1, -1, 127, -32, 300, -200, 0.5, 1.5] */
+  const char input[] =
+    "\x01\xff\x7f\xe0\xcd\x01\x2c\xd1\xff\x38"
+    "\xca\x3f\x00\x00\x00\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00";
+  const double expected[] = {1, -1, 127, -32, 300, -200, 0.5, 1.5};
+  size_t n = ARRAY_SIZE(expected);
+
+  bool equal = true;
+  for (size_t i = 0; i < ARRAY_SIZE(chunksizes) && equal; i++) {
+    mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+    double out[ARRAY_SIZE(expected)];
+    size_t done = 0, off = 0, read;
+    int status = MPACK_EOF;
+    while (status == MPACK_EOF && off < sizeof(input) - 1) {
+      const char *b = input + off;
+      size_t bl = MIN(chunksizes[i], sizeof(input) - 1 - off);
+      status = mpack_read_double_array(&tb, &b, &bl, out + done, n - done,
+          &read);
+      done += read;
+      off = (size_t)(b - input);
+    }
+    equal = status == MPACK_OK && done == n && off == sizeof(input) - 1 &&
+      !memcmp(out, expected, sizeof(out));
+  }
+  ok(equal, "numbers are decoded into a double array across split buffers");
+
+  {
+    /* a run of floats followed by a fixint: [0.25, -2.5, 1e10, 3] */
+    const char floats[] =
+      "\xca\x3e\x80\x00\x00\xcb\xc0\x04\x00\x00\x00\x00\x00\x00"
+      "\xcb\x42\x02\xa0\x5f\x20\x00\x00\x00\x03";
+    mpack_tokbuf_t ftb = MPACK_TOKBUF_INITIAL_VALUE;
+    float fout[4];
+    const char *fb = floats;
+    size_t fbl = sizeof(floats) - 1, fread;
+    ok(!mpack_read_float_array(&ftb, &fb, &fbl, fout, 4, &fread) &&
+        fread == 4 && !fbl && fout[0] == 0.25f && fout[1] == -2.5f &&
+        fout[2] == 1e10f && fout[3] == 3.0f,
+        "runs of floats are decoded into a float array");
+  }
+
+  mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+  mpack_sintmax_t sints[6];
+  mpack_uintmax_t uints[2];
+  size_t read;
+  const char *b = input;
+  size_t bl = sizeof(input) - 1;
+  ok(!mpack_read_sint_array(&tb, &b, &bl, sints, 6, &read) && read == 6 &&
+      sints[0] == 1 && sints[1] == -1 && sints[4] == 300 &&
+      sints[5] == -200, "integers are decoded into a signed array");
+  ok(mpack_read_sint_array(&tb, &b, &bl, sints, 1, &read) == MPACK_ERROR &&
+      read == 0, "floats are not converted to integers");
+  b = input;
+  bl = sizeof(input) - 1;
+  ok(mpack_read_uint_array(&tb, &b, &bl, uints, 2, &read) == MPACK_ERROR &&
+      read == 1 && uints[0] == 1,
+      "negative numbers are not converted to unsigned");
+}
+
+static void writer_number_array(void)
+{
+  const double v[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, 255.0, -129.0, -32769.0, 4294967296.0,
+    -10737418240.0, 9007199254740991.0, 4503599627370495.5, 1.5
+  };
+  const uint8_t expected[] = {
+    0x00, 0x00, 0x01, 0xff, 0xca, 0x3f, 0x00, 0x00, 0x00, 0xcc, 0xff, 0xd1,
+    0xff, 0x7f, 0xd2, 0xff, 0xff, 0x7f, 0xff, 0xcf, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0xd3, 0xff, 0xff, 0xff, 0xfd, 0x80, 0x00, 0x00,
+    0x00, 0xcf, 0x00, 0x1f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xcb, 0x43,
+    0x2f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xca, 0x3f, 0xc0, 0x00, 0x00
+  };
+  char out[sizeof(expected)];
+  mpack_writer_t w;
+  size_t pos = 0, written;
+  int status;
+
+  mpack_writer_init(&w, out, sizeof(out));
+  status = mpack_w_number_array(&w, v, ARRAY_SIZE(v), &written);
+  ok(status == MPACK_OK && written == ARRAY_SIZE(v) &&
+      (size_t)(w.buf - out) == sizeof(expected) &&
+      !memcmp(out, expected, sizeof(expected)),
+      "writes integral doubles as integers");
+
+  /* resume with one byte of output at a time */
+  memset(out, 0, sizeof(out));
+  mpack_writer_init(&w, out, 1);
+  do {
+    status = mpack_w_number_array(&w, v + pos, ARRAY_SIZE(v) - pos, &written);
+    pos += written;
+    w.buflen = w.buf < out + sizeof(out) ? 1 : 0;
+  } while (status == MPACK_EOF && w.buflen);
+  ok(status == MPACK_OK && pos == ARRAY_SIZE(v) &&
+      !memcmp(out, expected, sizeof(expected)),
+      "number array writes can be resumed");
+
+  {
+    enum { N = 256 };
+    mpack_uintmax_t u[N];
+    mpack_sintmax_t s[N];
+    float f[N];
+    double d[N], nums[N];
+    static char big[N * 9], ref[N * 9];
+    mpack_tokbuf_t tb = MPACK_TOKBUF_INITIAL_VALUE;
+    char *rp = ref;
+    size_t rl = sizeof(ref);
+
+    vector_values(u, s, f, d, N);
+    for (size_t k = 0; k < N; k++) {
+      /* integers of every width, and values that stay floats */
+      switch (k % 3) {
+        case 0: nums[k] = (double)s[k]; break;
+        case 1: nums[k] = (double)(u[k] & 0x1fffffffffffff); break;
+        default: nums[k] = (double)s[k] + 0.5; break;
+      }
+      mpack_token_t tok = mpack_pack_number(nums[k]);
+      status = mpack_write(&tb, &rp, &rl, &tok);
+      assert(!status);
+    }
+    mpack_writer_init(&w, big, sizeof(big));
+    status = mpack_w_number_array(&w, nums, N, &written);
+    ok((status == MPACK_OK && written == N && w.buf - big == rp - ref &&
+        !memcmp(big, ref, (size_t)(rp - ref))),
+        "number arrays match mpack_write of mpack_pack_number tokens");
+  }
+}
+
+#define DPARSER_DEPTH 300
+static bool dparser_parents_ok;
+static mpack_uint32_t dparser_max_depth;
+
+static void dparser_enter(mpack_dparser_t *parser, mpack_node_t *node)
+{
+  mpack_node_t *parent = MPACK_DPARENT_NODE(node);
+  mpack_uint32_t depth = parent ? (mpack_uint32_t)parent->data[1].u + 1 : 1;
+  if (parser->data.p) {
+    /* unparsing: nest arrays of one item down to a nil */
+    node->tok = depth <= DPARSER_DEPTH ? mpack_pack_array(1) : mpack_pack_nil();
+  }
+  node->data[0].p = parent;
+  node->data[1].u = depth;
+  if (depth > dparser_max_depth) dparser_max_depth = depth;
+}
+
+static void dparser_exit(mpack_dparser_t *parser, mpack_node_t *node)
+{
+  (void)parser;
+  if (MPACK_DPARENT_NODE(node) != node->data[0].p) dparser_parents_ok = false;
+}
+
+static void dparser_grows_in_chunks(void)
+{
+  uint8_t mp[DPARSER_DEPTH + 1];
+  /* one spare byte so the stack is unwound after the last token */
+  char out[sizeof(mp) + 1], *outp = out;
+  size_t mplen = sizeof(mp), outlen = sizeof(out);
+  const char *buf = (const char *)mp;
+  mpack_node_t items[4];
+  mpack_dparser_t parser;
+  int status;
+
+  memset(mp, 0x91, DPARSER_DEPTH);
+  mp[DPARSER_DEPTH] = 0xc0;
+
+  dparser_parents_ok = true;
+  dparser_max_depth = 0;
+  alloc_limit = sizeof(mpack_node_t) * 64;
+  mpack_dparser_init(&parser, items, ARRAY_SIZE(items), 0, test_alloc, NULL);
+  status = mpack_dparse(&parser, &buf, &mplen, dparser_enter, dparser_exit);
+  ok(status == MPACK_NOMEM && mplen, "dparser reports allocation failures");
+  alloc_limit = SIZE_MAX;
+  status = mpack_dparse(&parser, &buf, &mplen, dparser_enter, dparser_exit);
+  ok(status == MPACK_OK && !mplen && dparser_parents_ok &&
+      dparser_max_depth == DPARSER_DEPTH + 1,
+      "dparser resumes after memory is available");
+
+  dparser_max_depth = 0;
+  parser.data.p = &parser;
+  status = mpack_dunparse(&parser, &outp, &outlen, dparser_enter,
+      dparser_exit);
+  ok(status == MPACK_OK && outlen == 1 && dparser_parents_ok &&
+      !memcmp(out, mp, sizeof(mp)), "dparser unparses reusing its chunks");
+  mpack_dparser_destroy(&parser);
+
+  buf = (const char *)mp;
+  mplen = sizeof(mp);
+  mpack_dparser_init(&parser, NULL, 0, DPARSER_DEPTH, test_alloc, NULL);
+  status = mpack_dparse(&parser, &buf, &mplen, dparser_enter, dparser_exit);
+  ok(status == MPACK_NOMEM && mplen == 1, "dparser enforces max_depth");
+  mpack_dparser_destroy(&parser);
+}
+
+static void float_compat_exponent_range(void)
+{
+  bool pack_ok = true, unpack_ok = true;
+  /* every binary exponent, from the smallest subnormal to the largest
+   * finite double */
+  for (int e = -1074; e <= 1023; e++) {
+    double d = ldexp(e < -1022 ? 1.0 : 1.3, e);
+    mpack_token_t fast = mpack_pack_float_fast(d);
+    mpack_token_t compat = mpack_pack_float_compat(d);
+    if (fast.length != compat.length || memcmp(&fast.data.value,
+          &compat.data.value, sizeof(fast.data.value))) {
+      pack_ok = false;
+    }
+    if (mpack_unpack_float_compat(compat) != d) unpack_ok = false;
+  }
+  ok(pack_ok, "compat float packing matches across the exponent range");
+  ok(unpack_ok, "compat float unpacking matches across the exponent range");
+}
+
+static void float_compat_inf_nan(void)
+{
+  static const struct {
+    const char *msg;
+    size_t len;
+    int sign;
+    bool nan;
+  } cases[] = {
+    {"\xca\x7f\x80\x00\x00", 5, 1, false},
+    {"\xca\xff\x80\x00\x00", 5, -1, false},
+    {"\xca\x7f\xc0\x00\x00", 5, 1, true},
+    {"\xcb\x7f\xf0\x00\x00\x00\x00\x00\x00", 9, 1, false},
+    {"\xcb\xff\xf0\x00\x00\x00\x00\x00\x00", 9, -1, false},
+    {"\xcb\x7f\xf8\x00\x00\x00\x00\x00\x00", 9, 1, true},
+    {"\xcb\x7f\xf0\x00\x00\x00\x00\x00\x01", 9, 1, true}
+  };
+  bool unpack_ok = true, roundtrip_ok = true;
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    mpack_tokbuf_t reader = MPACK_TOKBUF_INITIAL_VALUE;
+    mpack_tokbuf_t writer = MPACK_TOKBUF_INITIAL_VALUE;
+    mpack_token_t tok;
+    const char *p = cases[i].msg;
+    size_t plen = cases[i].len;
+    char out[9];
+    char *o = out;
+    size_t olen = sizeof(out);
+    double d;
+
+    if (mpack_read(&reader, &p, &plen, &tok) || tok.type != MPACK_TOKEN_FLOAT) {
+      unpack_ok = false;
+      continue;
+    }
+    d = mpack_unpack_float_compat(tok);
+    if (cases[i].nan ? !isnan(d) : !isinf(d) || (d > 0) != (cases[i].sign > 0))
+      unpack_ok = false;
+
+    /* pack it again and read it back */
+    tok = mpack_pack_float_compat(d);
+    reader = (mpack_tokbuf_t)MPACK_TOKBUF_INITIAL_VALUE;
+    if (mpack_write(&writer, &o, &olen, &tok)) {
+      roundtrip_ok = false;
+      continue;
+    }
+    p = out;
+    plen = sizeof(out) - olen;
+    if (mpack_read(&reader, &p, &plen, &tok)) {
+      roundtrip_ok = false;
+      continue;
+    }
+    d = mpack_unpack_float_compat(tok);
+    if (cases[i].nan ? !isnan(d) : !isinf(d) || (d > 0) != (cases[i].sign > 0))
+      roundtrip_ok = false;
+  }
+  ok(unpack_ok, "compat float unpacking handles infinity and NaN");
+  ok(roundtrip_ok, "compat float packing round-trips infinity and NaN");
+}
+
 int main(void)
 {
-  for (int i = 0; i < fixture_count; i++) {
-    fixture_test(fixtures, i);
+  for (size_t i = 0; i < ARRAY_SIZE(walk_checks); i++) {
+    each_fixture(fixtures, fixture_count, walk_checks[i]);
   }
   signed_positive_packs_with_unsigned_format();
   positive_signed_format_unpacks_as_unsigned();
+  negative_formats_unpack_as_signed();
   unpacking_c1_returns_eread();
   parsing_very_deep_objects_returns_enomem();
   unparsing_very_deep_objects_returns_enomem();
   parse_throw();
   unparse_throw();
   does_not_write_invalid_tokens();
+  each_fixture(fixtures, fixture_count, read_batch_check);
+  each_fixture(fixtures, fixture_count, skip_check);
+  each_fixture(fixtures, fixture_count, validate_check);
+  each_fixture(fixtures, fixture_count, tape_check);
+  each_fixture(fixtures, fixture_count, write_batch_check);
+  skip_stops_at_value_boundary();
+  validate_enforces_limits();
+  tape_skip_pointers();
+  cursor_field_access();
+  extract_path();
+  query_patterns();
+  writer_typed_values();
+  writer_deferred_containers();
+  iowriter_references_large_chunks();
+  sbuf_grows_and_reports_nomem();
+  writer_numeric_arrays();
+  writer_vector_paths();
+  reader_vector_paths();
+  read_numeric_arrays();
+  float_compat_exponent_range();
+  float_compat_inf_nan();
+  writer_number_array();
+  dparser_grows_in_chunks();
   rpc_copy_session_maintains_state();
   rpc_request_id_wrap();
   number_conv = true;  /* test using mpack_{pack,unpack}_number to do the
@@ -740,8 +2188,8 @@ int main(void)
   for (int i = 0; i < rpc_fixture_count; i++) {
     rpc_fixture_test(i);
   }
-  for (int i = 0; i < number_fixture_count; i++) {
-    fixture_test(number_fixtures, i);
+  for (size_t i = 0; i < ARRAY_SIZE(walk_checks); i++) {
+    each_fixture(number_fixtures, number_fixture_count, walk_checks[i]);
   }
   /* test size macros */
   ok(sizeof(MPACK_PARSER_STRUCT(2)) == MPACK_PARSER_STRUCT_SIZE(2));